@@ -1,13 +1,20 @@
 #include <vector>
 #include <algorithm>
+#include <iterator>
 #include <iostream>
 #include <math.h>
-#include <random>
+#include <cmath>
+#include <limits>
 #include "ant.h"
 #include "ant_colony.h"
 #include "tour_atom.h"
 
-Ant::Ant(Problem *problem) : problem{problem}, num_visited_customers{0}, current_vehicle_number{0}, current_time{0}, current_load{0}, current_distance{0}
+namespace
+{
+const unsigned int no_bucket = std::numeric_limits<unsigned int>::max();
+}
+
+Ant::Ant(Problem *problem, uint64_t seed) : problem{problem}, rng{seed}, num_visited_customers{0}, current_vehicle_number{0}, current_time{0}, current_load{0}, current_distance{0}, num_moves{0}, num_candidates{0}, selection_kernel{get_selection_kernel()}
 {
 }
 
@@ -19,7 +26,7 @@ std::vector<TourAtom> Ant::construct_solution_nn()
     // While not all customers have been visited we keep adding arcs
     while (num_visited_customers < problem->get_num_available_customers())
     {
-        std::vector<unsigned int> candidate_nodes_ids = compute_candidate_arcs();
+        const std::vector<unsigned int> &candidate_nodes_ids = compute_candidate_arcs();
 
         if (candidate_nodes_ids.size() == 0)
         {
@@ -27,6 +34,9 @@ std::vector<TourAtom> Ant::construct_solution_nn()
             return {};
         }
 
+        num_moves++;
+        num_candidates += candidate_nodes_ids.size();
+
         unsigned int selected_node_id = select_arc_nn(candidate_nodes_ids);
 
         insert_selected_arc(selected_node_id);
@@ -35,13 +45,13 @@ std::vector<TourAtom> Ant::construct_solution_nn()
     return solution;
 }
 
-std::vector<TourAtom> Ant::construct_solution_acs(AntColony *ant_colony, float alpha, float beta, float q_0, float rho)
+std::vector<TourAtom> Ant::construct_solution_acs(const AntColony *ant_colony, float q_0)
 {
     initialize_tour();
 
     while (num_visited_customers < problem->get_num_available_customers())
     {
-        std::vector<unsigned int> candidate_nodes_ids = compute_candidate_arcs();
+        const std::vector<unsigned int> &candidate_nodes_ids = compute_candidate_arcs();
 
         if (candidate_nodes_ids.size() == 0)
         {
@@ -49,7 +59,10 @@ std::vector<TourAtom> Ant::construct_solution_acs(AntColony *ant_colony, float a
             return {};
         }
 
-        unsigned int selected_node_id = select_arc_acs(candidate_nodes_ids, ant_colony, alpha, beta, q_0, rho);
+        num_moves++;
+        num_candidates += candidate_nodes_ids.size();
+
+        unsigned int selected_node_id = select_arc_acs(candidate_nodes_ids, ant_colony, q_0);
 
         insert_selected_arc(selected_node_id);
     }
@@ -57,18 +70,30 @@ std::vector<TourAtom> Ant::construct_solution_acs(AntColony *ant_colony, float a
     return solution;
 }
 
+unsigned long Ant::get_num_moves() const
+{
+    return num_moves;
+}
+
+unsigned long Ant::get_num_candidates() const
+{
+    return num_candidates;
+}
+
 void Ant::initialize_tour()
 {
+    initialize_candidates();
+
     // Pick a random depot as starting node
     // Generate integer in the range [1, num_vehicles]
     // And set it as current vehicle
-    current_vehicle_number = rand() % problem->get_num_vehicles() + 1;
+    current_vehicle_number = rng.uniform_int(problem->get_num_vehicles()) + 1;
 
     // Add num_customers to get the node_id
     current_node_id = current_vehicle_number + problem->get_num_customers();
 
     // The node has been visited, can't be visited  later
-    visited_nodes.push_back(current_node_id);
+    remove_depot_candidate(current_node_id);
 
     // Add it to the solution
     solution.push_back(TourAtom(current_node_id, current_load, current_time, current_distance));
@@ -80,64 +105,146 @@ void Ant::initialize_tour()
 void Ant::insert_committed_customers(unsigned int vehicle_number)
 {
     // Iterate over committed customers for the vehicle_number to add them to the tour
+    // They are served when the plan they were committed with serves them
     for (auto &committed_c_node_id : problem->get_vehicle_commitments(vehicle_number))
     {
         current_load += problem->get_customer_demand(committed_c_node_id);
-        current_time += problem->get_distance(current_node_id, committed_c_node_id);
-        current_time += problem->get_customer_service_time(committed_c_node_id);
+        current_time = problem->get_commitment_end_of_service(committed_c_node_id);
         current_distance += problem->get_distance(current_node_id, committed_c_node_id);
 
         current_node_id = committed_c_node_id;
 
         solution.push_back(TourAtom(current_node_id, current_load, current_time, current_distance));
 
-        visited_nodes.push_back(committed_c_node_id);
+        // Committed customers are never candidates so there is nothing to remove
         num_visited_customers++;
     }
+
+    // The rest of the route can't be served in the past
+    current_time = problem->get_departure_time(current_time);
+}
+
+void Ant::initialize_candidates()
+{
+    // The candidates are all the available customers which have not been committed, grouped by demand
+    unsigned int num_vehicles = problem->get_num_vehicles();
+    unsigned int num_customers = problem->get_num_customers();
+
+    c_node_position = std::vector<unsigned int>(num_customers + 1, 0);
+    c_node_bucket = std::vector<unsigned int>(num_customers + 1, no_bucket);
+
+    const std::vector<unsigned int> &available_c_nodes_ids = problem->get_available_c_nodes_ids_by_demand();
+    unvisited_c_nodes_ids.reserve(available_c_nodes_ids.size());
+
+    for (auto &c_node_id : available_c_nodes_ids)
+    {
+        if (problem->has_c_node_been_committed(c_node_id))
+        {
+            continue;
+        }
+
+        // The customers come sorted by demand so a new bucket starts whenever the demand changes
+        int demand = problem->get_customer_demand(c_node_id);
+        if (buckets_demand.empty() || buckets_demand.back() != demand)
+        {
+            buckets_begin.push_back(unvisited_c_nodes_ids.size());
+            buckets_size.push_back(0);
+            buckets_demand.push_back(demand);
+        }
+
+        c_node_position[c_node_id] = unvisited_c_nodes_ids.size();
+        c_node_bucket[c_node_id] = buckets_demand.size() - 1;
+        unvisited_c_nodes_ids.push_back(c_node_id);
+        buckets_size.back()++;
+    }
+
+    depot_position = std::vector<unsigned int>(num_vehicles + 1, 0);
+    unvisited_depots_ids.reserve(num_vehicles);
+
+    for (auto vehicle_number = 1; vehicle_number <= num_vehicles; vehicle_number++)
+    {
+        depot_position[vehicle_number] = unvisited_depots_ids.size();
+        unvisited_depots_ids.push_back(num_customers + vehicle_number);
+    }
+
+    // A move never has more candidates than that, so the buffers will not grow anymore
+    candidate_nodes_ids.reserve(unvisited_c_nodes_ids.size() + num_vehicles);
+    weights.reserve(unvisited_c_nodes_ids.size() + num_vehicles);
 }
 
-std::vector<unsigned int> Ant::compute_candidate_arcs() const
+const std::vector<unsigned int> &Ant::compute_candidate_arcs()
 {
-    // Given the current state of the ant (current_load, current_vehicle, visited_nodes, ...)
+    // Given the current state of the ant (current_load, current_vehicle, visited nodes, ...)
     // compute the candidate nodes_ids for the next move
 
-    // We do this by iteratively removing nodes_ids from all the available nodes of the problem
-    std::vector<unsigned int> candidate_nodes_ids = problem->get_available_nodes_ids();
+    // When candidate lists are enabled we first only look at the nearest neighbours of the current node
+    // and fall back to all the candidates when none of them is feasible anymore
+    if (problem->get_num_neighbours() > 0 && compute_candidate_arcs_from_neighbours())
+    {
+        return candidate_nodes_ids;
+    }
+
+    candidate_nodes_ids.clear();
 
-    // We remove the nodes that have already been visited
-    candidate_nodes_ids.erase(std::remove_if(candidate_nodes_ids.begin(),
-                                             candidate_nodes_ids.end(),
-                                             [this](unsigned int node_id) { return has_node_been_visited(node_id); }),
-                              candidate_nodes_ids.end());
+    // The visited and committed customers are not in the buckets anymore
+    // and we only walk the buckets whose demand fits in what is left of the vehicle
+    int capacity_left = (int)problem->get_vehicle_capacity() - current_load;
+
+    for (auto bucket = 0; bucket < buckets_demand.size() && buckets_demand[bucket] <= capacity_left; bucket++)
+    {
+        auto begin = unvisited_c_nodes_ids.begin() + buckets_begin[bucket];
+        if (problem->has_time_windows())
+        {
+            // The customers whose window the vehicle can't reach anymore are left out one by one
+            std::copy_if(begin, begin + buckets_size[bucket], std::back_inserter(candidate_nodes_ids),
+                         [this](unsigned int c_node_id) { return fits_time_window(c_node_id); });
+        }
+        else
+        {
+            candidate_nodes_ids.insert(candidate_nodes_ids.end(), begin, begin + buckets_size[bucket]);
+        }
+    }
 
     // If we are at a depot we can't go to a depot
-    // So we filter the depot nodes from the candidates
-    if (problem->is_node_depot(current_node_id))
+    if (!problem->is_node_depot(current_node_id))
     {
-        candidate_nodes_ids.erase(std::remove_if(candidate_nodes_ids.begin(),
-                                                 candidate_nodes_ids.end(),
-                                                 [this](unsigned int node_id) { return problem->is_node_depot(node_id); }),
-                                  candidate_nodes_ids.end());
+        candidate_nodes_ids.insert(candidate_nodes_ids.end(), unvisited_depots_ids.begin(), unvisited_depots_ids.end());
     }
 
-    // We remove the nodes that have been committed to other vehicles
-    // Note : The nodes committed to the current vehicle have already been added to the tour when this function is called
-    //        so they can't appear here
-    candidate_nodes_ids.erase(std::remove_if(candidate_nodes_ids.begin(),
-                                             candidate_nodes_ids.end(),
-                                             [this](unsigned int node_id) { return problem->has_c_node_been_committed(node_id); }),
-                              candidate_nodes_ids.end());
+    return candidate_nodes_ids;
+}
 
-    // We remove nodes whose demand it too high given the current_load
-    candidate_nodes_ids.erase(std::remove_if(candidate_nodes_ids.begin(),
-                                             candidate_nodes_ids.end(),
-                                             [this](unsigned int node_id) { return problem->get_customer_demand(node_id) + current_load > problem->get_vehicle_capacity(); }),
-                              candidate_nodes_ids.end());
+bool Ant::compute_candidate_arcs_from_neighbours()
+{
+    candidate_nodes_ids.clear();
 
-    return candidate_nodes_ids;
+    // We keep the neighbours that are still candidates and that fit in the vehicle
+    for (auto &node_id : problem->get_neighbours(current_node_id))
+    {
+        if (is_customer_candidate(node_id) &&
+            problem->get_customer_demand(node_id) + current_load <= problem->get_vehicle_capacity() &&
+            fits_time_window(node_id))
+        {
+            candidate_nodes_ids.push_back(node_id);
+        }
+    }
+
+    // No feasible customer in the list, the caller falls back to the full candidate set
+    if (candidate_nodes_ids.empty())
+    {
+        return false;
+    }
+
+    // Returning to a depot must stay possible, unless we are already at a depot
+    if (!problem->is_node_depot(current_node_id))
+    {
+        candidate_nodes_ids.insert(candidate_nodes_ids.end(), unvisited_depots_ids.begin(), unvisited_depots_ids.end());
+    }
+
+    return true;
 }
 
-unsigned int Ant::select_arc_nn(std::vector<unsigned int> candidate_nodes_ids) const
+unsigned int Ant::select_arc_nn(const std::vector<unsigned int> &candidate_nodes_ids) const
 {
     // Simply pick the arc with the least distance
     unsigned int node_id = 0;
@@ -155,48 +262,29 @@ unsigned int Ant::select_arc_nn(std::vector<unsigned int> candidate_nodes_ids) c
     return node_id;
 }
 
-unsigned int Ant::select_arc_acs(std::vector<unsigned int> candidate_nodes_ids, AntColony *ant_colony, float alpha, float beta, float q_0, float rho) const
+unsigned int Ant::select_arc_acs(const std::vector<unsigned int> &candidate_nodes_ids, const AntColony *ant_colony, float q_0)
 {
-    // We compute the weights
-    std::vector<float> weights;
-    for (auto &candidate_node_id : candidate_nodes_ids)
-    {
-        float eta_ij = (float)1 / problem->get_distance(current_node_id, candidate_node_id);
-        float tau_ij = ant_colony->get_pheromons(current_node_id, candidate_node_id);
-        float weight = pow(tau_ij, alpha) * pow(eta_ij, beta);
+    // The weights tau^alpha * eta^beta are cached by the colony, we only read them
+    unsigned int num_candidates = candidate_nodes_ids.size();
+    weights.resize(num_candidates);
+    ant_colony->get_pheromon_store().gather_choice_info(current_node_id, candidate_nodes_ids.data(), num_candidates, weights.data());
 
-        weights.push_back(weight);
-    }
-    // TODO: Move this somewhere else
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> uniform(0, 1);
-    float sample = uniform(gen);
+    float sample = rng.uniform();
 
     bool exploitation = sample <= q_0 ? true : false;
     unsigned int selected_node_id;
 
     if (exploitation)
     {
-        auto index_of_max = std::distance(weights.begin(), std::max_element(weights.begin(), weights.end()));
+        auto index_of_max = selection_kernel.argmax(weights.data(), num_candidates);
         selected_node_id = candidate_nodes_ids[index_of_max];
     }
     else
     {
-        float normalization_constant = 0;
-        for (auto &weight : weights)
-        {
-            normalization_constant += weight;
-        }
+        // We turn the weights into their cumulative sums in place, there is no need to normalize them
+        float total_weight = selection_kernel.prefix_sum(weights.data(), num_candidates);
 
-        std::vector<float> distribution;
-        for (auto &weight : weights)
-        {
-            float normalized_weight = weight / normalization_constant;
-            distribution.push_back(normalized_weight);
-        }
-
-        auto sampled_index = sample_from_categorical(distribution);
+        auto sampled_index = sample_from_cumulative(weights.data(), num_candidates, total_weight);
         selected_node_id = candidate_nodes_ids[sampled_index];
     }
 
@@ -215,67 +303,113 @@ void Ant::insert_selected_arc(unsigned int selected_node_id)
 
         solution.push_back(TourAtom(selected_node_id, 0, 0, 0));
 
-        visited_nodes.push_back(selected_node_id);
+        remove_depot_candidate(selected_node_id);
 
         insert_committed_customers(current_vehicle_number);
     }
     else
     {
         current_load += problem->get_customer_demand(selected_node_id);
-        current_time += problem->get_distance(current_node_id, selected_node_id);
-        current_time += problem->get_customer_service_time(selected_node_id);
+        current_time = service_end_time(selected_node_id);
         current_distance += problem->get_distance(current_node_id, selected_node_id);
 
         current_node_id = selected_node_id;
 
         solution.push_back(TourAtom(selected_node_id, current_load, current_time, current_distance));
 
-        visited_nodes.push_back(selected_node_id);
+        remove_customer_candidate(selected_node_id);
         num_visited_customers++;
     }
 }
 
-bool Ant::has_node_been_visited(unsigned int node_id) const
+void Ant::remove_customer_candidate(unsigned int c_node_id)
+{
+    // We move the last customer of the bucket in place of the removed one
+    unsigned int bucket = c_node_bucket[c_node_id];
+    unsigned int position = c_node_position[c_node_id];
+    unsigned int last_position = buckets_begin[bucket] + buckets_size[bucket] - 1;
+    unsigned int last_c_node_id = unvisited_c_nodes_ids[last_position];
+
+    unvisited_c_nodes_ids[position] = last_c_node_id;
+    c_node_position[last_c_node_id] = position;
+
+    buckets_size[bucket]--;
+    c_node_bucket[c_node_id] = no_bucket;
+}
+
+void Ant::remove_depot_candidate(unsigned int depot_node_id)
 {
-    std::vector<unsigned int>::const_iterator it;
-    it = std::find(visited_nodes.begin(), visited_nodes.end(), node_id);
+    unsigned int vehicle_number = depot_node_id - problem->get_num_customers();
+    unsigned int position = depot_position[vehicle_number];
+    unsigned int last_depot_node_id = unvisited_depots_ids.back();
+
+    unvisited_depots_ids[position] = last_depot_node_id;
+    depot_position[last_depot_node_id - problem->get_num_customers()] = position;
 
-    return (it != visited_nodes.end());
+    unvisited_depots_ids.pop_back();
 }
 
-unsigned int Ant::sample_from_categorical(const std::vector<float> &distribution) const
+bool Ant::is_customer_candidate(unsigned int c_node_id) const
 {
-    // Given a vector of float whose sum is 1
-    // Return a random index sampled according to the distribution
-    // specified by the vector
+    return c_node_bucket[c_node_id] != no_bucket;
+}
 
-    unsigned int num_bins = distribution.size();
-    std::vector<std::pair<float, float>> bins;
+float Ant::service_end_time(unsigned int c_node_id) const
+{
+    float service_start_time = current_time + problem->get_distance(current_node_id, c_node_id);
+    if (problem->has_time_windows())
+    {
+        service_start_time = std::max(service_start_time, problem->get_customer_ready_time(c_node_id));
+    }
 
-    float acc = 0;
+    return service_start_time + problem->get_customer_service_time(c_node_id);
+}
 
-    for (auto i = 0; i < num_bins; i++)
+bool Ant::fits_time_window(unsigned int c_node_id) const
+{
+    if (!problem->has_time_windows())
     {
-        bins.push_back(std::make_pair(acc, acc + distribution[i]));
-        acc += distribution[i];
+        return true;
     }
 
-    // TODO: Move this somewhere else
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> uniform(0, 1);
-    float sample = uniform(gen);
+    // The slack of the customer is what is left of its window when the vehicle gets there ;
+    // the time of the vehicle only grows along its route, so a customer whose due date is already
+    // behind it is dropped before its distance is even read
+    float slack = problem->get_customer_due_date(c_node_id) - current_time;
+    if (slack < 0)
+    {
+        return false;
+    }
 
-    unsigned int index;
+    return slack >= problem->get_distance(current_node_id, c_node_id);
+}
 
-    for (auto i = 0; i < bins.size(); i++)
+unsigned int Ant::sample_from_cumulative(const float *cumulative_weights, unsigned int num_candidates, float total_weight)
+{
+    // Given the cumulative sums of non negative weights
+    // Return a random index sampled with a probability proportional to its weight
+    // The bin of the sample is found by binary search
+
+    // A zero length arc gives an infinite weight, we take the first one
+    if (std::isinf(total_weight))
     {
-        if (bins[i].first <= sample && sample < bins[i].second)
-        {
-            index = i;
-            break;
-        }
+        return std::distance(cumulative_weights, std::find(cumulative_weights, cumulative_weights + num_candidates, total_weight));
+    }
+
+    // All the weights underflowed, every candidate is as good as another
+    if (!(total_weight > 0))
+    {
+        return rng.uniform_int(num_candidates);
     }
 
-    return index;
-}
\ No newline at end of file
+    float sample = rng.uniform() * total_weight;
+    auto it = std::upper_bound(cumulative_weights, cumulative_weights + num_candidates, sample);
+
+    // Rounding can push the sample up to the total weight
+    if (it == cumulative_weights + num_candidates)
+    {
+        it--;
+    }
+
+    return std::distance(cumulative_weights, it);
+}
@@ -3,8 +3,11 @@
 #include <vector>
 #include "problem.h"
 #include "tour_atom.h"
+#include "random_generator.h"
+#include "selection_kernel.h"
 
 class AntColony;
+class AntBenchmark;
 
 class Ant
 {
@@ -12,8 +15,8 @@ private:
     Problem *problem;
     const std::vector<std::vector<float>> *pheromon_matrix;
     std::vector<TourAtom> solution;
+    RandomGenerator rng;
 
-    std::vector<unsigned int> visited_nodes;
     unsigned int num_visited_customers;
     unsigned int current_node_id;
     unsigned int current_vehicle_number;
@@ -21,20 +24,57 @@ private:
     int current_load;
     float current_distance;
 
+    // The customers that can still be visited (available, not visited and not committed) are kept
+    // in demand ordered buckets so that the capacity filter only walks the buckets that fit.
+    // Inside a bucket they are removed by swapping with the last customer of the bucket.
+    std::vector<unsigned int> unvisited_c_nodes_ids;
+    std::vector<unsigned int> c_node_position;
+    std::vector<unsigned int> c_node_bucket; // no_bucket when the customer is not a candidate
+    std::vector<unsigned int> buckets_begin;
+    std::vector<unsigned int> buckets_size;
+    std::vector<int> buckets_demand;
+
+    // Same swap-remove scheme for the depots which have not been visited
+    std::vector<unsigned int> unvisited_depots_ids;
+    std::vector<unsigned int> depot_position;
+
+    // Moves made and candidates they were chosen among, for the metrics
+    unsigned long num_moves;
+    unsigned long num_candidates;
+
+    // Buffers reused by every move, the candidates and their weights form a structure of arrays for the selection kernel
+    std::vector<unsigned int> candidate_nodes_ids;
+    std::vector<float> weights;
+    const SelectionKernel &selection_kernel;
+
     void initialize_tour();
-    std::vector<unsigned int> compute_candidate_arcs() const;
-    unsigned int select_arc_nn(std::vector<unsigned int> candidate_nodes_ids) const;
-    unsigned int select_arc_acs(std::vector<unsigned int> candidate_nodes_ids, AntColony *ant_colony, float alpha, float beta, float q_0, float rho) const;
+    void initialize_candidates();
+    const std::vector<unsigned int> &compute_candidate_arcs();
+    bool compute_candidate_arcs_from_neighbours();
+    unsigned int select_arc_nn(const std::vector<unsigned int> &candidate_nodes_ids) const;
+    unsigned int select_arc_acs(const std::vector<unsigned int> &candidate_nodes_ids, const AntColony *ant_colony, float q_0);
     void insert_selected_arc(unsigned int selected_node_id);
 
     void insert_committed_customers(unsigned int vehicle_number);
-    bool has_node_been_visited(unsigned int node_id) const;
+    void remove_customer_candidate(unsigned int c_node_id);
+    void remove_depot_candidate(unsigned int depot_node_id);
+    bool is_customer_candidate(unsigned int c_node_id) const;
 
-    unsigned int sample_from_categorical(const std::vector<float> &distribution) const;
+    // With time windows the vehicle waits for the ready time of a customer it reaches too early
+    float service_end_time(unsigned int c_node_id) const;
+    bool fits_time_window(unsigned int c_node_id) const;
+
+    unsigned int sample_from_cumulative(const float *cumulative_weights, unsigned int num_candidates, float total_weight);
+
+    // The microbenchmarks drive the moves one by one
+    friend class AntBenchmark;
 
 public:
-    Ant(Problem *problem);
+    Ant(Problem *problem, uint64_t seed);
 
     std::vector<TourAtom> construct_solution_nn();
-    std::vector<TourAtom> construct_solution_acs(AntColony *ant_colony, float alpha, float beta, float q_0, float rho);
-};
\ No newline at end of file
+    std::vector<TourAtom> construct_solution_acs(const AntColony *ant_colony, float q_0);
+
+    unsigned long get_num_moves() const;
+    unsigned long get_num_candidates() const;
+};
@@ -4,96 +4,188 @@
 #include "tour_atom.h"
 #include "ant.h"
 #include <algorithm>
+#include <chrono>
 #include "local_search.h"
-AntColony::AntColony(Problem *problem, unsigned int num_ants, float alpha, float beta, float q_0, float rho) : problem{problem}, num_ants{num_ants}, alpha{alpha}, beta{beta}, q_0{q_0}, rho{rho}
+AntColony::AntColony(Problem *problem, unsigned int num_ants, float alpha, float beta, float q_0, float rho, const AntColonyOptions &options) : pheromons{problem, alpha, beta, options.sparse_pheromons}, problem{problem}, num_ants{num_ants}, alpha{alpha}, beta{beta}, q_0{q_0}, rho{rho}, local_search{options.local_search}, seed{options.seed}, num_random_streams{0}, measure_timings{false}, max_rebuild_attempts{options.max_rebuild_attempts}, rebuild_time_limit{options.rebuild_time_limit}
 {
+    if (options.num_threads > 1)
+    {
+        thread_pool = std::unique_ptr<ThreadPool>(new ThreadPool(options.num_threads));
+    }
+
+    if (options.local_search_worker)
+    {
+        local_search_worker = std::unique_ptr<LocalSearchWorker>(new LocalSearchWorker(*problem));
+    }
+
     // We create an initial solution using Nearest Neighbour to get tau_0
-    Ant ant = Ant(problem);
+    Ant ant = Ant(problem, RandomGenerator::derive_seed(seed, next_random_stream(), 0));
     std::vector<TourAtom> initial_solution = ant.construct_solution_nn();
+    best_solution_complete = true;
+
+    // When the nearest neighbour gets stuck (e.g. on tight time windows), the customers are inserted by regret insertion,
+    // the solution may then leave some of them out
+    if (initial_solution.empty())
+    {
+        Local_search repair(*problem, initial_solution);
+        best_solution_complete = repair.insert_customers(problem->get_available_c_nodes_ids(), thread_pool.get()).empty();
+        initial_solution = repair.solution_from_search();
+    }
+
     float initial_solution_score = compute_solution_score(initial_solution);
+    best_solution = initial_solution;
     best_solution_score = initial_solution_score;
 
     // We compute tau_0 following Gambardella 1999
     tau_0 = (float)1 / ((float)problem->get_num_available_nodes() * initial_solution_score);
 
-    // <DEBUG>
-    // Print initial solution
-    std::cout << "Solution @ AntColony initialization: " << std::endl;
-    for (auto &tour_atom : initial_solution)
+    if (options.trace)
     {
-        std::cout << "(" << tour_atom.node_id << ", " << tour_atom.load << ", " << tour_atom.end_of_service << ", " << tour_atom.distance << ")" << std::endl;
+        options.trace->trace_initial_solution(initial_solution, initial_solution_score);
     }
 
-    std::cout << "Score @ AntColony initialization: " << initial_solution_score << std::endl;
-    // </ DEBUG>
+    // We initialize the pheromons to tau_0
+    pheromons.reset(tau_0);
 
-    // We initialize the pheromons matrix to tau_0
-    auto flat_matrix_size = (problem->get_num_nodes() + 1) * (problem->get_num_nodes() + 1);
-    pheromon_matrix = std::vector<float>(flat_matrix_size, tau_0);
+    if (local_search_worker)
+    {
+        local_search_worker->submit(best_solution);
+    }
 }
 
 void AntColony::step()
 {
-    // Create a copy of the global pheromon matrix for local updates
-    std::vector<float> local_pheromon_matrix = pheromon_matrix;
+    // Each ant writes its solution in its own slot so that the results can be merged in ant order,
+    // whichever thread constructed them
+    // The ants all read the pheromons as they were at the begining of the step, the local updates are applied
+    // to the shared matrix once they are all done
+    collect_local_search_result();
+
+    std::vector<std::vector<TourAtom>> ants_solutions(num_ants);
+    std::vector<unsigned long> ants_num_moves(num_ants);
+    std::vector<unsigned long> ants_num_candidates(num_ants);
+    uint64_t random_stream = next_random_stream();
+
+    std::chrono::steady_clock::time_point time_0;
+    if (measure_timings)
+    {
+        time_0 = std::chrono::steady_clock::now();
+    }
 
-    std::vector<std::vector<TourAtom>> solutions;
-    std::vector<float> solutions_scores;
+    auto construct_solution = [this, &ants_solutions, &ants_num_moves, &ants_num_candidates, random_stream](unsigned int ant_index, unsigned int worker_index) {
+        Ant ant = Ant(problem, RandomGenerator::derive_seed(seed, random_stream, ant_index));
+        ants_solutions[ant_index] = ant.construct_solution_acs(this, q_0);
+        ants_num_moves[ant_index] = ant.get_num_moves();
+        ants_num_candidates[ant_index] = ant.get_num_candidates();
+    };
 
     // Try to construct a solution for num_ants ants
+    if (thread_pool)
+    {
+        thread_pool->run(num_ants, construct_solution);
+    }
+    else
+    {
+        for (auto i = 0; i < num_ants; i++)
+        {
+            construct_solution(i, 0);
+        }
+    }
+
+    std::chrono::steady_clock::time_point time_1;
+    if (measure_timings)
+    {
+        time_1 = std::chrono::steady_clock::now();
+        statistics.construction_time += std::chrono::duration<double>(time_1 - time_0).count();
+    }
+
+    statistics.num_steps++;
+    statistics.num_ants_built += num_ants;
     for (auto i = 0; i < num_ants; i++)
     {
-        Ant ant = Ant(problem);
-        std::vector<TourAtom> acs_solution = ant.construct_solution_acs(this, alpha, beta, q_0, rho);
+        statistics.num_moves += ants_num_moves[i];
+        statistics.num_candidates += ants_num_candidates[i];
+    }
 
+    std::vector<std::vector<TourAtom>> solutions;
+    std::vector<float> solutions_scores;
+
+    // We merge the ants deterministically, in ant order
+    for (auto &acs_solution : ants_solutions)
+    {
         // The ant got stuck and wasn't able to complete its solution
         // TODO : Maybe we should still update locally to prevent other ants from following the same path
         if (acs_solution.empty())
         {
+            statistics.num_ants_stuck++;
             continue;
         }
 
         float acs_solution_score = compute_solution_score(acs_solution);
 
-        // Update locally
+        // Update locally, the tour of the ant is the journal of the arcs to update
+        // so the cost is proportional to its length and not to the size of the matrix
         for (auto i = 1; i < acs_solution.size(); i++)
         {
             unsigned int node_id_i = acs_solution[i - 1].node_id;
             unsigned int node_id_j = acs_solution[i].node_id;
 
-            unsigned int index = node_id_i * (problem->get_num_nodes() + 1) + node_id_j;
-            local_pheromon_matrix[index] *= (1. - rho);
-            local_pheromon_matrix[index] += rho * tau_0;
+            pheromons.update(node_id_i, node_id_j, rho, tau_0);
         }
 
-        // Local search didn't improve the solution, so the next lines are commented out.
-        //Local_search ls = Local_search(*problem, acs_solution);
-        // Here we lunch the local search for 30 seconds max.
-        //ls.search(30);
-        //auto ls_solution = ls.solution_from_search();
-        //auto ls_solution_score = ls.compute_solution_score(ls_solution);
-        //solutions.push_back(ls_solution);
-        //solutions_scores.push_back(ls_solution_score);
-
-        solutions.push_back(acs_solution);
+        solutions.push_back(std::move(acs_solution));
         solutions_scores.push_back(acs_solution_score);
     }
 
     // If the ants have not found a single feasible solution
     if (solutions.empty())
     {
+        if (measure_timings)
+        {
+            statistics.pheromon_update_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - time_1).count();
+        }
         return;
     }
 
     // Find best solution among the constructed ones
     auto index_of_min = std::distance(solutions_scores.begin(), std::min_element(solutions_scores.begin(), solutions_scores.end()));
 
+    // Only the iteration best is improved, it is the one the global update may deposit on
+    // The worker gets it while the next ants are constructed, it replaces the one of the previous step if it was not started
+    if (local_search_worker)
+    {
+        local_search_worker->submit(solutions[index_of_min]);
+    }
+
+    double step_local_search_time = 0;
+    if (local_search && !local_search_worker)
+    {
+        std::chrono::steady_clock::time_point local_search_time_0;
+        if (measure_timings)
+        {
+            local_search_time_0 = std::chrono::steady_clock::now();
+        }
+
+        Local_search iteration_best_search(*problem, solutions[index_of_min]);
+        unsigned int num_local_search_moves = iteration_best_search.search();
+        if (num_local_search_moves > 0)
+        {
+            solutions[index_of_min] = iteration_best_search.solution_from_search();
+            solutions_scores[index_of_min] = compute_solution_score(solutions[index_of_min]);
+        }
+        statistics.num_local_search_moves += num_local_search_moves;
+
+        if (measure_timings)
+        {
+            step_local_search_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - local_search_time_0).count();
+            statistics.local_search_time += step_local_search_time;
+        }
+    }
+
     // If it is better than the current best solution we should update it
-    if (solutions_scores[index_of_min] < best_solution_score)
+    if (improves_best_solution(solutions_scores[index_of_min], true))
     {
-        best_solution = solutions[index_of_min];
-        best_solution_score = solutions_scores[index_of_min];
-        tau_0 = best_solution_score;
+        accept_best_solution(std::move(solutions[index_of_min]), solutions_scores[index_of_min], true);
     }
 
     // Update globally
@@ -102,69 +194,212 @@ void AntColony::step()
         unsigned int node_id_i = best_solution[i - 1].node_id;
         unsigned int node_id_j = best_solution[i].node_id;
 
-        unsigned int index = node_id_i * (problem->get_num_nodes() + 1) + node_id_j;
-        pheromon_matrix.at(index) *= (1. - rho);
-        pheromon_matrix.at(index) += rho * (1. / best_solution_score);
+        pheromons.update(node_id_i, node_id_j, rho, 1. / best_solution_score);
+    }
+
+    if (measure_timings)
+    {
+        statistics.pheromon_update_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - time_1).count() - step_local_search_time;
     }
 }
 
 void AntColony::update_solution()
 {
     // This method is called after the problem has been updated to insert the new available nodes.
-    // We simply use an ant to construct a NN tour (this will take into account the nodes that have just been committed)
-    // and set the current best_solution to this construction
-    // This method is only call when the diff returned by problem.update is not empty (otherwise we would lose the current best solution for nothing)
+    // The new customers are inserted into the current best solution by regret insertion, its committed customers
+    // stay where they are. When some of them fit nowhere, we fall back to constructing whole ACS solutions,
+    // for a bounded number of attempts and time, so that a new plan is always ready quickly.
+    // This method is only call when the diff returned by problem.update is not empty
+
+    // The candidate lists have been recomputed with the new nodes, the sparse pheromons follow them
+    pheromons.refresh_neighbours();
 
-    // Initialize an ant
-    // ant = Ant(problem);
+    // The customers the best solution does not serve are the ones that just arrived
+    std::vector<bool> served_c_nodes(problem->get_num_nodes() + 1, false);
+    for (auto &tour_atom : best_solution)
+    {
+        served_c_nodes[tour_atom.node_id] = true;
+    }
 
-    auto counter = 1;
-    // We try to find an ACS solution
-    while (true)
+    std::vector<unsigned int> new_c_nodes_ids;
+    for (auto &c_node_id : problem->get_available_c_nodes_ids())
     {
-        Ant ant_2 = Ant(problem);
-        auto solution = ant_2.construct_solution_acs(this, alpha, beta, q_0, rho);
-        if (!solution.empty())
+        if (!served_c_nodes[c_node_id])
         {
-            // We have no choice but to update the current best solution because there are new nodes that we have to take into account
-            best_solution = solution;
-            best_solution_score = compute_solution_score(solution);
-            break;
+            new_c_nodes_ids.push_back(c_node_id);
         }
-        counter++;
     }
 
-    // <DEBUG>
-    std::cout << "It took " << counter << " iterations to find a feasible solution accounting for the new nodes." << std::endl;
-    std::cout << "The score of the initial solution accounting for the new nodes is " << best_solution_score << std::endl;
-    // </ DEBUG>
+    // The pheromons learnt on the previous problem are kept, evaporated towards tau_0,
+    // while the arcs of the new customers, which no ant could use yet, start from tau_0
+    // Both are journaled by the store, the rows catch up when the ants read them
+    // This is done first so that the ants of the rebuild read the heuristic of the new customers
+    pheromons.evaporate(rho, tau_0);
+    pheromons.reset_nodes(new_c_nodes_ids, tau_0);
 
+    Local_search repair(*problem, best_solution);
+    std::vector<unsigned int> uninserted_c_nodes_ids = repair.insert_customers(new_c_nodes_ids, thread_pool.get());
+    statistics.num_inserted_customers += new_c_nodes_ids.size() - uninserted_c_nodes_ids.size();
+
+    if (uninserted_c_nodes_ids.empty() && local_search && !local_search_worker)
+    {
+        statistics.num_local_search_moves += repair.search();
+    }
+
+    std::vector<TourAtom> repaired_solution = repair.solution_from_search();
+    float repaired_solution_score = compute_solution_score(repaired_solution);
+
+    if (!uninserted_c_nodes_ids.empty())
+    {
+        auto time_0 = std::chrono::steady_clock::now();
+        uint64_t random_stream = next_random_stream();
+
+        for (unsigned int attempt = 0; attempt < max_rebuild_attempts; attempt++)
+        {
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - time_0).count() >= rebuild_time_limit)
+            {
+                break;
+            }
+
+            statistics.num_rebuild_attempts++;
+            Ant ant = Ant(problem, RandomGenerator::derive_seed(seed, random_stream, attempt));
+            auto solution = ant.construct_solution_acs(this, q_0);
+            if (!solution.empty())
+            {
+                repaired_solution = std::move(solution);
+                repaired_solution_score = compute_solution_score(repaired_solution);
+                break;
+            }
+        }
+    }
+
+    // We have no choice but to replace the best solution, it has to account for the new customers
+    // If neither the insertion nor the rebuild could serve all of them, the plan is incomplete
+    // until the working day rejects the customers it leaves out
+    // The completeness is read before the solution is moved into the argument
+    bool complete = is_complete(repaired_solution);
+    accept_best_solution(std::move(repaired_solution), repaired_solution_score, complete);
+
+    if (local_search_worker)
+    {
+        local_search_worker->submit(best_solution);
+    }
+}
+
+bool AntColony::is_complete(const std::vector<TourAtom> &solution) const
+{
+    unsigned int num_served_customers = 0;
+    for (auto &tour_atom : solution)
+    {
+        if (!problem->is_node_depot(tour_atom.node_id))
+        {
+            // A solution found before a rejection may still serve the rejected customer
+            if (problem->has_c_node_been_rejected(tour_atom.node_id))
+            {
+                return false;
+            }
+            num_served_customers++;
+        }
+    }
+
+    return num_served_customers == problem->get_num_available_customers();
+}
+
+bool AntColony::improves_best_solution(float score, bool complete) const
+{
+    // An incomplete plan gives way to any complete solution, whatever its score
+    if (complete != best_solution_complete)
+    {
+        return complete;
+    }
+
+    return score < best_solution_score;
+}
+
+void AntColony::accept_best_solution(std::vector<TourAtom> solution, float score, bool complete)
+{
+    best_solution = std::move(solution);
+    best_solution_score = score;
+    best_solution_complete = complete;
     tau_0 = 1. / ((float)problem->get_num_available_nodes() * best_solution_score);
+}
+
+bool AntColony::offer_solution(const std::vector<TourAtom> &solution, float score)
+{
+    bool complete = is_complete(solution);
+    if (!improves_best_solution(score, complete))
+    {
+        return false;
+    }
+
+    accept_best_solution(solution, score, complete);
+    return true;
+}
+
+void AntColony::remove_rejected_customers()
+{
+    std::vector<TourAtom> solution;
+    for (auto &tour_atom : best_solution)
+    {
+        if (problem->is_node_depot(tour_atom.node_id) || !problem->has_c_node_been_rejected(tour_atom.node_id))
+        {
+            solution.push_back(tour_atom);
+        }
+    }
+
+    // The atoms of the routes which lost a customer are computed again
+    if (solution.size() != best_solution.size())
+    {
+        solution = Local_search(*problem, solution).solution_from_search();
+    }
 
-    // TODO : Do we override the full matrix with the new tau_0 or only the new available nodes arcs ?
+    float score = compute_solution_score(solution);
+    bool complete = is_complete(solution);
+    accept_best_solution(std::move(solution), score, complete);
 
-    // We have two options here
-    // 1. Override the whole pheromon matrix with the new tau_0 -> losing information about previous problems which had less customers
-    // 2. Evaporate them
+    if (local_search_worker)
+    {
+        local_search_worker->submit(best_solution);
+    }
+}
 
-    // Option 1 is better for problems with low dynamicity
-    // Option 2 is better for problems with high dynamicity
+void AntColony::collect_local_search_result()
+{
+    if (!local_search_worker)
+    {
+        return;
+    }
 
-    // For now we take option 2
-    for (auto i = 0; i < pheromon_matrix.size(); i++)
+    // The result may come from an older best solution, the ants could have found a better one since
+    auto result = local_search_worker->take_result();
+    if (result)
     {
-        pheromon_matrix[i] *= (1. - rho);
-        pheromon_matrix[i] += rho * tau_0;
+        statistics.num_local_search_moves += result->num_moves;
+        bool complete = is_complete(result->solution);
+        if (improves_best_solution(result->score, complete))
+        {
+            accept_best_solution(std::move(result->solution), result->score, complete);
+        }
     }
+}
+
+void AntColony::synchronize_local_search()
+{
+    if (local_search_worker)
+    {
+        local_search_worker->synchronize();
+        collect_local_search_result();
+    }
+}
 
-    // We override the pheromons matrix to tau_0
-    // auto flat_matrix_size = (problem->get_num_nodes() + 1) * (problem->get_num_nodes() + 1);
-    // pheromon_matrix = std::vector<float>(flat_matrix_size, tau_0);
+float AntColony::get_pheromons(unsigned int node_id_i, unsigned int node_id_j) const
+{
+    return pheromons.get(node_id_i, node_id_j);
 }
 
-float AntColony::get_pheromons(unsigned int node_id_i, unsigned int node_id_j)
+const PheromoneStore &AntColony::get_pheromon_store() const
 {
-    return pheromon_matrix.at(node_id_i * (problem->get_num_nodes() + 1) + node_id_j);
+    return pheromons;
 }
 
 const std::vector<TourAtom> &AntColony::get_best_solution() const
@@ -172,11 +407,41 @@ const std::vector<TourAtom> &AntColony::get_best_solution() const
     return best_solution;
 }
 
+bool AntColony::is_best_solution_complete() const
+{
+    return best_solution_complete;
+}
+
 float AntColony::get_best_solution_score() const
 {
     return best_solution_score;
 }
 
+unsigned int AntColony::get_num_threads() const
+{
+    return thread_pool ? thread_pool->get_num_threads() : 1;
+}
+
+const ColonyStatistics &AntColony::get_statistics() const
+{
+    return statistics;
+}
+
+void AntColony::reset_statistics()
+{
+    statistics = ColonyStatistics();
+}
+
+void AntColony::set_measure_timings(bool measure_timings)
+{
+    this->measure_timings = measure_timings;
+}
+
+uint64_t AntColony::next_random_stream()
+{
+    return num_random_streams++;
+}
+
 float AntColony::compute_solution_score(const std::vector<TourAtom> &solution) const
 {
     float score = 0;
@@ -1,16 +1,64 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include "problem.h"
 #include "ant.h"
 #include "tour_atom.h"
+#include "thread_pool.h"
+#include "pheromone_store.h"
+#include "local_search_worker.h"
+#include "trace_writer.h"
+
+// Settings of AntColony which are not parameters of the ACS itself
+struct AntColonyOptions
+{
+    // Threads constructing the ants of a step
+    unsigned int num_threads = 1;
+    uint64_t seed = 0;
+    // Only store the pheromons of the candidate list arcs (needs candidate lists)
+    bool sparse_pheromons = false;
+    // Improve the best ant of every step with Local_search before the global update
+    bool local_search = false;
+    // Improve the new best solutions with Local_search on a background thread instead, while the ants are constructed
+    bool local_search_worker = false;
+    // When the new customers of a timeslice can't all be inserted into the best solution, ACS solutions are
+    // constructed until one serves every customer, for at most that many attempts and seconds
+    // The time limit makes the days depend on the host, it is infinite when they must be reproducible
+    unsigned int max_rebuild_attempts = 1000;
+    double rebuild_time_limit = 1;
+    // Receives the initial solution, nullptr to trace nothing
+    TraceWriter *trace = nullptr;
+};
+
+// Counters of the steps since the last call to reset_statistics
+struct ColonyStatistics
+{
+    unsigned long num_steps = 0;
+    unsigned long num_ants_built = 0;
+    // Ants that got stuck and returned an empty solution
+    unsigned long num_ants_stuck = 0;
+    unsigned long num_moves = 0;
+    unsigned long num_candidates = 0;
+    // In seconds, only measured when the timings are enabled
+    double construction_time = 0;
+    double pheromon_update_time = 0;
+    double local_search_time = 0;
+    unsigned long num_local_search_moves = 0;
+    // New customers inserted into the best solution by update_solution, and solutions constructed when they didn't fit
+    unsigned long num_inserted_customers = 0;
+    unsigned long num_rebuild_attempts = 0;
+};
 
 class AntColony
 {
 private:
     std::vector<TourAtom> best_solution;
     float best_solution_score;
-    std::vector<float> pheromon_matrix;
+    // False when update_solution could not serve every new customer, any complete solution then replaces it
+    // The working day rejects the customers such a solution leaves out, so that the ants can complete theirs again
+    bool best_solution_complete;
+    PheromoneStore pheromons;
 
     Problem *problem;
     unsigned int num_ants;
@@ -19,18 +67,52 @@ private:
     float q_0;
     float rho;
     float tau_0;
+    bool local_search;
+
+    // Every ant gets its own random stream derived from the master seed, the step and its index
+    uint64_t seed;
+    uint64_t num_random_streams;
+
+    ColonyStatistics statistics;
+    bool measure_timings;
+
+    unsigned int max_rebuild_attempts;
+    double rebuild_time_limit;
+
+    // Only allocated when the ants are constructed on more than one thread
+    std::unique_ptr<ThreadPool> thread_pool;
+    std::unique_ptr<LocalSearchWorker> local_search_worker;
 
     float compute_solution_score(const std::vector<TourAtom> &solution) const;
+    uint64_t next_random_stream();
+    bool is_complete(const std::vector<TourAtom> &solution) const;
+    bool improves_best_solution(float score, bool complete) const;
+    void accept_best_solution(std::vector<TourAtom> solution, float score, bool complete);
+    void collect_local_search_result();
 
 public:
-    AntColony(Problem *problem, unsigned int num_ants, float alpha, float beta, float q_0, float rho);
+    AntColony(Problem *problem, unsigned int num_ants, float alpha, float beta, float q_0, float rho, const AntColonyOptions &options);
 
     void step();
     void update_solution();
-    float get_pheromons(unsigned int node_id_i, unsigned int node_id_j);
+    // Takes the solution (e.g. migrated from another colony) as best solution if it is better than the current one
+    bool offer_solution(const std::vector<TourAtom> &solution, float score);
+    // Takes the customers rejected by the problem out of the best solution, to be called after Problem::reject
+    void remove_rejected_customers();
+    // Waits for the local search worker and takes its last result, to be called before the problem changes
+    void synchronize_local_search();
+    float get_pheromons(unsigned int node_id_i, unsigned int node_id_j) const;
+    const PheromoneStore &get_pheromon_store() const;
 
     const std::vector<TourAtom> &get_best_solution() const;
     float get_best_solution_score() const;
+    bool is_best_solution_complete() const;
+    unsigned int get_num_threads() const;
+
+    const ColonyStatistics &get_statistics() const;
+    void reset_statistics();
+    // The timings read the clock twice per step, the counters are always kept
+    void set_measure_timings(bool measure_timings);
 
     void visual_dump_data() const;
 };
\ No newline at end of file
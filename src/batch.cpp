@@ -0,0 +1,395 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+
+#include "problem.h"
+#include "ant_colony.h"
+#include "thread_pool.h"
+#include "working_day.h"
+#include "island_model.h"
+
+// Runs every instance with every combination of the parameter grid, several runs at a time,
+// and writes one line per run in a CSV results table
+
+namespace
+{
+struct BatchRun
+{
+    std::string instance;
+    unsigned int num_ants;
+    float alpha;
+    float beta;
+    float q_0;
+    float rho;
+    unsigned int num_neighbours;
+    uint64_t seed;
+};
+
+struct BatchResult
+{
+    bool loaded = false;
+    WorkingDayResult working_day;
+    double runtime = 0;
+};
+
+template <typename T>
+bool parse_list(const std::string &text, std::vector<T> &values)
+{
+    // Comma separated values, e.g. 0.8,0.9,0.95
+    values.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        std::istringstream item_iss(item);
+        T value;
+        if (!(item_iss >> value))
+        {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+bool read_instance_list(const std::string &filename, std::vector<std::string> &instances)
+{
+    std::ifstream list_file(filename);
+    if (!list_file)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(list_file, line))
+    {
+        if (!line.empty() && line[0] != '#')
+        {
+            instances.push_back(line);
+        }
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> instances;
+    std::string output_filepath = "results.csv";
+    unsigned int num_jobs = 1;
+    unsigned int num_threads = 1;
+    bool local_search = false;
+    bool local_search_worker = false;
+    unsigned int num_islands = 1;
+    unsigned int migration_interval = 50;
+    unsigned int t_wd = 100;
+    unsigned int n_ts = 50;
+    double duration = 75;
+    WorkingDayOptions working_day_options;
+    ProblemOptions problem_options;
+
+    std::vector<unsigned int> grid_num_ants = {10};
+    std::vector<float> grid_alpha = {1};
+    std::vector<float> grid_beta = {1};
+    std::vector<float> grid_q_0 = {0.9};
+    std::vector<float> grid_rho = {0.1};
+    std::vector<unsigned int> grid_num_neighbours = {0};
+    std::vector<uint64_t> grid_seeds = {0};
+
+    std::string usage = std::string("Usage: ") + argv[0] + " [--instance-list file] [--output file.csv] [--jobs J] [--threads T] [--t-wd T] [--n-ts N] [--duration seconds]" +
+                        " [--steps-per-timeslice N | --cpu-time-per-timeslice seconds]" +
+                        " [--distance-backend dense|triangular|half|on-the-fly|auto] [--time-windows 0|1] [--local-search 0|1] [--local-search-worker 0|1] [--islands N] [--migration-interval steps]" +
+                        " [--ants list] [--alpha list] [--beta list] [--q0 list] [--rho list] [--candidates list] [--seeds list] [instance...]";
+
+    for (auto i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool parsed = true;
+
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            instances.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        if (arg == "--instance-list")
+        {
+            parsed = read_instance_list(value, instances);
+        }
+        else if (arg == "--output")
+        {
+            output_filepath = value;
+        }
+        else if (arg == "--jobs")
+        {
+            num_jobs = std::stoul(value);
+        }
+        else if (arg == "--threads")
+        {
+            num_threads = std::max(1ul, std::stoul(value));
+        }
+        else if (arg == "--t-wd")
+        {
+            t_wd = std::stoul(value);
+        }
+        else if (arg == "--n-ts")
+        {
+            n_ts = std::stoul(value);
+        }
+        else if (arg == "--duration")
+        {
+            duration = std::stod(value);
+        }
+        else if (arg == "--steps-per-timeslice")
+        {
+            working_day_options.budget = TimesliceBudget::Steps;
+            working_day_options.steps_per_timeslice = std::stoul(value);
+            parsed = working_day_options.steps_per_timeslice > 0;
+        }
+        else if (arg == "--cpu-time-per-timeslice")
+        {
+            working_day_options.budget = TimesliceBudget::CpuTime;
+            working_day_options.cpu_time_per_timeslice = std::stod(value);
+        }
+        else if (arg == "--distance-backend")
+        {
+            parsed = DistanceOracle::parse_backend(value, problem_options.distance_backend);
+        }
+        else if (arg == "--time-windows")
+        {
+            problem_options.time_windows = std::stoul(value) != 0;
+        }
+        else if (arg == "--local-search")
+        {
+            local_search = std::stoul(value) != 0;
+        }
+        else if (arg == "--local-search-worker")
+        {
+            local_search_worker = std::stoul(value) != 0;
+        }
+        else if (arg == "--islands")
+        {
+            num_islands = std::max(1ul, std::stoul(value));
+        }
+        else if (arg == "--migration-interval")
+        {
+            migration_interval = std::stoul(value);
+        }
+        else if (arg == "--ants")
+        {
+            parsed = parse_list(value, grid_num_ants);
+        }
+        else if (arg == "--alpha")
+        {
+            parsed = parse_list(value, grid_alpha);
+        }
+        else if (arg == "--beta")
+        {
+            parsed = parse_list(value, grid_beta);
+        }
+        else if (arg == "--q0")
+        {
+            parsed = parse_list(value, grid_q_0);
+        }
+        else if (arg == "--rho")
+        {
+            parsed = parse_list(value, grid_rho);
+        }
+        else if (arg == "--candidates")
+        {
+            parsed = parse_list(value, grid_num_neighbours);
+        }
+        else if (arg == "--seeds")
+        {
+            parsed = parse_list(value, grid_seeds);
+        }
+        else
+        {
+            parsed = false;
+        }
+
+        if (!parsed)
+        {
+            std::cerr << "Invalid value " << value << " for " << arg << "." << std::endl;
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+    }
+
+    if (instances.empty())
+    {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    // 0 means as many runs at a time as the cores allow with the threads of each run
+    if (num_jobs == 0)
+    {
+        num_jobs = std::max(1u, std::thread::hardware_concurrency() / (num_islands > 1 ? num_islands : num_threads));
+    }
+
+    // The CPU time budget counts the whole process, the runs would spend each other's
+    if (working_day_options.budget == TimesliceBudget::CpuTime && num_jobs > 1)
+    {
+        std::cerr << "The CPU time budget counts every run of the process, the runs are done one at a time." << std::endl;
+        num_jobs = 1;
+    }
+
+    // We expand the grid, the seeds vary fastest so that the repetitions of a configuration are next to each other
+    std::size_t num_configurations = grid_num_ants.size() * grid_alpha.size() * grid_beta.size() * grid_q_0.size() *
+                                     grid_rho.size() * grid_num_neighbours.size() * grid_seeds.size();
+    std::vector<BatchRun> runs;
+    for (auto &instance : instances)
+    {
+        for (std::size_t configuration = 0; configuration < num_configurations; configuration++)
+        {
+            // The index of the configuration is decomposed with one digit per parameter
+            std::size_t index = configuration;
+            BatchRun run;
+            run.instance = instance;
+            run.seed = grid_seeds[index % grid_seeds.size()];
+            index /= grid_seeds.size();
+            run.num_neighbours = grid_num_neighbours[index % grid_num_neighbours.size()];
+            index /= grid_num_neighbours.size();
+            run.rho = grid_rho[index % grid_rho.size()];
+            index /= grid_rho.size();
+            run.q_0 = grid_q_0[index % grid_q_0.size()];
+            index /= grid_q_0.size();
+            run.beta = grid_beta[index % grid_beta.size()];
+            index /= grid_beta.size();
+            run.alpha = grid_alpha[index % grid_alpha.size()];
+            index /= grid_alpha.size();
+            run.num_ants = grid_num_ants[index];
+
+            runs.push_back(run);
+        }
+    }
+
+    std::cerr << runs.size() << " runs, " << num_jobs << " at a time with " << num_threads << " thread(s) each." << std::endl;
+
+    std::vector<BatchResult> results(runs.size());
+    std::mutex progress_mutex;
+    unsigned int num_finished_runs = 0;
+
+    // Each run gets its own problem since the commitments modify it
+    auto run_one = [&](unsigned int run_index, unsigned int worker_index) {
+        const BatchRun &run = runs[run_index];
+        BatchResult &result = results[run_index];
+        auto time_0 = std::chrono::high_resolution_clock::now();
+
+        ProblemOptions run_problem_options = problem_options;
+        run_problem_options.num_neighbours = run.num_neighbours;
+        run_problem_options.num_threads = num_threads;
+        if (!local_search && !local_search_worker)
+        {
+            run_problem_options.num_local_search_neighbours = 0;
+        }
+
+        std::unique_ptr<Problem> problem;
+        try
+        {
+            problem = std::unique_ptr<Problem>(new Problem(run.instance, t_wd, n_ts, run_problem_options));
+            result.loaded = true;
+        }
+        catch (const std::runtime_error &error)
+        {
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            std::cerr << error.what() << "." << std::endl;
+        }
+
+        if (result.loaded)
+        {
+            problem->update(0);
+
+            AntColonyOptions ant_colony_options;
+            ant_colony_options.num_threads = num_threads;
+            ant_colony_options.seed = run.seed;
+            ant_colony_options.local_search = local_search;
+            ant_colony_options.local_search_worker = local_search_worker;
+            if (working_day_options.budget == TimesliceBudget::Steps)
+            {
+                ant_colony_options.rebuild_time_limit = std::numeric_limits<double>::infinity();
+            }
+
+            WorkingDayOptions run_working_day_options = working_day_options;
+            run_working_day_options.t_ts = (double)t_wd / (double)n_ts;
+            run_working_day_options.duration = duration;
+            run_working_day_options.verbose = false;
+
+            if (num_islands > 1)
+            {
+                // The islands all get the parameters of the run, they only differ by their seeds
+                IslandParameters parameters;
+                parameters.num_ants = run.num_ants;
+                parameters.alpha = run.alpha;
+                parameters.beta = run.beta;
+                parameters.q_0 = run.q_0;
+                parameters.rho = run.rho;
+
+                IslandModelOptions island_model_options;
+                island_model_options.ant_colony_options = ant_colony_options;
+                island_model_options.migration_interval = migration_interval;
+
+                IslandModel island_model(problem.get(), std::vector<IslandParameters>(num_islands, parameters), island_model_options);
+                result.working_day = run_working_day(*problem, island_model, run_working_day_options);
+            }
+            else
+            {
+                AntColony ant_colony(problem.get(), run.num_ants, run.alpha, run.beta, run.q_0, run.rho, ant_colony_options);
+                result.working_day = run_working_day(*problem, ant_colony, run_working_day_options);
+            }
+        }
+        result.runtime = elapsed_since(time_0);
+
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        num_finished_runs++;
+        std::cerr << "Run " << num_finished_runs << "/" << runs.size() << " done (" << run.instance << ", seed " << run.seed << ")." << std::endl;
+    };
+
+    ThreadPool thread_pool(num_jobs);
+    thread_pool.run(runs.size(), run_one);
+
+    // The table is written in the order of the grid, whatever the order the runs finished in
+    std::ofstream output_file(output_filepath);
+    output_file << "instance,num_ants,alpha,beta,q_0,rho,candidates,seed,threads,islands,timeslices,score,scaled_back_score,steps_per_timeslice,runtime" << std::endl;
+    for (auto i = 0; i < runs.size(); i++)
+    {
+        const BatchRun &run = runs[i];
+        const BatchResult &result = results[i];
+
+        output_file << run.instance << "," << run.num_ants << "," << run.alpha << "," << run.beta << "," << run.q_0 << "," << run.rho << ","
+                    << run.num_neighbours << "," << run.seed << "," << num_threads << "," << num_islands << ",";
+        if (result.loaded)
+        {
+            output_file << result.working_day.num_timeslices << "," << result.working_day.score << "," << result.working_day.scaled_back_score << ","
+                        << result.working_day.steps_per_timeslice << "," << result.runtime << std::endl;
+        }
+        else
+        {
+            output_file << ",,,," << result.runtime << std::endl;
+        }
+    }
+
+    if (!output_file)
+    {
+        std::cerr << "Can't write the results table " << output_filepath << "." << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Results written to " << output_filepath << "." << std::endl;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+#include "problem.h"
+#include "ant.h"
+#include "ant_colony.h"
+#include "local_search.h"
+#include "random_generator.h"
+#include "selection_kernel.h"
+
+// Microbenchmarks of the hot paths of the solver on generated instances
+// The instances and the seeds are fixed so that two runs of the same binary on the same host are comparable
+
+namespace
+{
+const unsigned int t_wd = 100;
+const unsigned int n_ts = 50;
+const uint64_t colony_seed = 1;
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+// The results of the measured calls are stored here so that the compiler can't drop the calls
+volatile double sink;
+
+double seconds_since(const bench_clock::time_point &time)
+{
+    std::chrono::duration<double> elapsed = bench_clock::now() - time;
+    return elapsed.count();
+}
+
+void report(const std::string &name, unsigned int num_customers, unsigned long iterations, double mean_seconds)
+{
+    std::cout << std::left << std::setw(40) << name << std::right << std::setw(10) << num_customers << std::setw(12) << iterations
+              << std::setw(16) << std::fixed << std::setprecision(3) << mean_seconds * 1e6 << std::endl;
+}
+
+// Calls function until it ran for min_time seconds (and at least once), reports the mean time of a call
+template <typename Function>
+void measure(const std::string &name, unsigned int num_customers, double min_time, Function function)
+{
+    unsigned long iterations = 0;
+    auto time_0 = bench_clock::now();
+    do
+    {
+        function();
+        iterations++;
+    } while (seconds_since(time_0) < min_time);
+
+    report(name, num_customers, iterations, seconds_since(time_0) / iterations);
+}
+
+// Writes an instance in the Van Veen format, with uniform customers on a 100 x 100 square
+// There are enough vehicles for the ants to (almost) never get stuck
+void write_instance(const std::string &filename, unsigned int num_customers, uint64_t seed)
+{
+    RandomGenerator rng(seed);
+    unsigned int num_vehicles = num_customers / 4 + 1;
+
+    std::ofstream instance_file(filename);
+    instance_file << "BENCH" << num_customers << "\n\nVEHICLE\nNUMBER     CAPACITY\n  " << num_vehicles << "         200\n\nCUSTOMER\n";
+    instance_file << "CUST NO.  XCOORD.   YCOORD.    DEMAND   READY TIME  DUE DATE   SERVICE   TIME\n\n";
+    instance_file << "0 50 50 0 0 240 0 0\n";
+
+    for (auto i = 1; i <= num_customers; i++)
+    {
+        unsigned int ready_time = rng.uniform_int(180);
+        // A third of the customers are known at the start of the day, the others arrive before their ready time
+        float available_time = rng.uniform() < 0.3 ? 0 : rng.uniform() * ready_time * 0.7;
+        instance_file << i << " " << rng.uniform_int(101) << " " << rng.uniform_int(101) << " " << rng.uniform_int(40) + 1 << " "
+                      << ready_time << " " << ready_time + 30 << " 10 " << available_time << "\n";
+    }
+}
+
+template <typename T>
+bool parse_list(const std::string &text, std::vector<T> &values)
+{
+    values.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        std::istringstream item_iss(item);
+        T value;
+        if (!(item_iss >> value))
+        {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+void bench_selection_kernels(double min_time)
+{
+    // The kernels are measured on candidate sets of the sizes met with candidate lists and without
+    std::string default_kernel = get_selection_kernel().name;
+    RandomGenerator rng(colony_seed);
+
+    for (unsigned int num_candidates : {16u, 256u, 4096u})
+    {
+        std::vector<float> choice_info_row(num_candidates * 4);
+        std::vector<unsigned int> candidate_nodes_ids(num_candidates);
+        std::vector<float> weights(num_candidates);
+        for (auto &choice_info : choice_info_row)
+        {
+            choice_info = rng.uniform();
+        }
+        for (auto &candidate_node_id : candidate_nodes_ids)
+        {
+            candidate_node_id = rng.uniform_int(choice_info_row.size());
+        }
+
+        for (auto name : {"scalar", "avx2", "avx512"})
+        {
+            if (!set_selection_kernel(name))
+            {
+                continue;
+            }
+            const SelectionKernel &kernel = get_selection_kernel();
+            std::string suffix = std::string(" [") + name + "]";
+
+            // The number of candidates goes in the size column
+            measure("kernel gather_weights" + suffix, num_candidates, min_time, [&]() {
+                kernel.gather_weights(choice_info_row.data(), candidate_nodes_ids.data(), num_candidates, weights.data());
+            });
+            measure("kernel argmax" + suffix, num_candidates, min_time, [&]() {
+                sink = kernel.argmax(weights.data(), num_candidates);
+            });
+            measure("kernel prefix_sum" + suffix, num_candidates, min_time, [&]() {
+                // The sums are done in place so we start again from the gathered weights
+                kernel.gather_weights(choice_info_row.data(), candidate_nodes_ids.data(), num_candidates, weights.data());
+                sink = kernel.prefix_sum(weights.data(), num_candidates);
+            });
+        }
+    }
+
+    set_selection_kernel(default_kernel);
+}
+} // namespace
+
+// Drives an ant move by move, which the public interface of Ant doesn't allow
+class AntBenchmark
+{
+public:
+    // Mean time of compute_candidate_arcs along nearest neighbour tours
+    static void compute_candidate_arcs(Problem &problem, double min_time)
+    {
+        unsigned long num_calls = 0;
+        double total_time = 0;
+        uint64_t index = 0;
+        auto time_0 = bench_clock::now();
+
+        do
+        {
+            Ant ant(&problem, RandomGenerator::derive_seed(colony_seed, 0, index++));
+            ant.initialize_tour();
+
+            while (ant.num_visited_customers < problem.get_num_available_customers())
+            {
+                auto call_time_0 = bench_clock::now();
+                const std::vector<unsigned int> &candidate_nodes_ids = ant.compute_candidate_arcs();
+                total_time += seconds_since(call_time_0);
+                num_calls++;
+
+                if (candidate_nodes_ids.empty())
+                {
+                    break;
+                }
+                ant.insert_selected_arc(ant.select_arc_nn(candidate_nodes_ids));
+            }
+        } while (seconds_since(time_0) < min_time);
+
+        report("Ant::compute_candidate_arcs", problem.get_num_customers(), num_calls, total_time / std::max(1ul, num_calls));
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned int> sizes = {100, 1000, 10000};
+    unsigned int num_neighbours = 20;
+    double min_time = 0.5;
+
+    for (auto i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--sizes" && i + 1 < argc && parse_list(argv[i + 1], sizes))
+        {
+            i++;
+        }
+        else if (arg == "--candidates" && i + 1 < argc)
+        {
+            num_neighbours = std::stoul(argv[++i]);
+        }
+        else if (arg == "--min-time" && i + 1 < argc)
+        {
+            min_time = std::stod(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--sizes 100,1000,10000] [--candidates k] [--min-time seconds]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Selection kernel " << get_selection_kernel().name << ", " << num_neighbours << " nearest neighbours candidate lists, times in microseconds." << std::endl;
+    std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(10) << "size" << std::setw(12) << "iterations" << std::setw(16) << "mean (us)" << std::endl;
+
+    bench_selection_kernels(min_time);
+
+    for (auto num_customers : sizes)
+    {
+        std::string filename = "dvrp_bench_" + std::to_string(num_customers) + ".txt";
+        write_instance(filename, num_customers, num_customers);
+
+        ProblemOptions problem_options;
+        problem_options.num_neighbours = num_neighbours;
+
+        auto load_time_0 = bench_clock::now();
+        Problem problem(filename, t_wd, n_ts, problem_options);
+        report("Problem::Problem", num_customers, 1, seconds_since(load_time_0));
+        std::remove(filename.c_str());
+
+        // We release the customers of the whole day, one timeslice at a time
+        auto update_time_0 = bench_clock::now();
+        for (auto timeslice = 0; timeslice <= n_ts / 2; timeslice++)
+        {
+            problem.update(timeslice * (float)t_wd / n_ts);
+        }
+        report("Problem::update", num_customers, n_ts / 2 + 1, seconds_since(update_time_0) / (n_ts / 2 + 1));
+
+        uint64_t ant_index = 0;
+        measure("Ant::construct_solution_nn", num_customers, min_time, [&]() {
+            Ant ant(&problem, RandomGenerator::derive_seed(colony_seed, 0, ant_index++));
+            sink = ant.construct_solution_nn().size();
+        });
+
+        AntColonyOptions ant_colony_options;
+        ant_colony_options.seed = colony_seed;
+        AntColony ant_colony(&problem, 10, 1, 1, 0.9, 0.1, ant_colony_options);
+
+        measure("Ant::construct_solution_acs", num_customers, min_time, [&]() {
+            Ant ant(&problem, RandomGenerator::derive_seed(colony_seed, 0, ant_index++));
+            sink = ant.construct_solution_acs(&ant_colony, 0.9).size();
+        });
+
+        AntBenchmark::compute_candidate_arcs(problem, min_time);
+
+        measure("AntColony::step", num_customers, min_time, [&]() {
+            ant_colony.step();
+        });
+
+        measure("AntColony::update_solution", num_customers, min_time, [&]() {
+            ant_colony.update_solution();
+        });
+
+        // The local search starts again from the same solution every time
+        std::vector<TourAtom> solution = ant_colony.get_best_solution();
+        measure("Local_search::search", num_customers, min_time, [&]() {
+            Local_search local_search(problem, solution);
+            local_search.search();
+        });
+    }
+}
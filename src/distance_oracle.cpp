@@ -0,0 +1,457 @@
+#include "distance_oracle.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DISTANCE_ORACLE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// The tables are built by blocks of rows, which are the tasks of the thread pool
+const std::size_t block_size = 64;
+
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t float_exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    int exponent = (int)float_exponent - 127 + 15;
+
+    // Infinity and NaN
+    if (float_exponent == 0xff)
+    {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+
+    // Too large, rounds to infinity
+    if (exponent >= 31)
+    {
+        return sign | 0x7c00;
+    }
+
+    // Subnormal half or zero, rounded to nearest even
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return sign;
+        }
+
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half_mantissa = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+        {
+            half_mantissa++;
+        }
+
+        return sign | half_mantissa;
+    }
+
+    // Normal half, rounded to nearest even (a carry correctly bumps the exponent)
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    {
+        half++;
+    }
+
+    return half;
+}
+
+float half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal half, normalized for the float
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+float euclidean_distance(float x_i, float y_i, float x_j, float y_j)
+{
+    float dx = x_i - x_j;
+    float dy = y_i - y_j;
+
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// Distances from (x_i, y_i) to the first count nodes
+void distance_row_scalar(float x_i, float y_i, const float *x, const float *y, std::size_t count, float *row)
+{
+    for (std::size_t j = 0; j < count; j++)
+    {
+        row[j] = euclidean_distance(x_i, y_i, x[j], y[j]);
+    }
+}
+
+#ifdef DISTANCE_ORACLE_X86
+// sqrtps is correctly rounded like sqrtf so both versions give exactly the same tables
+__attribute__((target("avx2"))) void distance_row_avx2(float x_i, float y_i, const float *x, const float *y, std::size_t count, float *row)
+{
+    __m256 x_i_vector = _mm256_set1_ps(x_i);
+    __m256 y_i_vector = _mm256_set1_ps(y_i);
+
+    std::size_t j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m256 dx = _mm256_sub_ps(x_i_vector, _mm256_loadu_ps(x + j));
+        __m256 dy = _mm256_sub_ps(y_i_vector, _mm256_loadu_ps(y + j));
+        __m256 squared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        _mm256_storeu_ps(row + j, _mm256_sqrt_ps(squared));
+    }
+
+    distance_row_scalar(x_i, y_i, x + j, y + j, count - j, row + j);
+}
+#endif
+
+void float_row_to_half_scalar(const float *row, std::size_t count, uint16_t *half_row)
+{
+    for (std::size_t j = 0; j < count; j++)
+    {
+        half_row[j] = float_to_half(row[j]);
+    }
+}
+
+#ifdef DISTANCE_ORACLE_X86
+// F16C rounds to nearest even like float_to_half
+__attribute__((target("avx2,f16c"))) void float_row_to_half_f16c(const float *row, std::size_t count, uint16_t *half_row)
+{
+    std::size_t j = 0;
+    for (; j + 8 <= count; j += 8)
+    {
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(row + j), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(half_row + j), half);
+    }
+
+    float_row_to_half_scalar(row + j, count - j, half_row + j);
+}
+#endif
+
+typedef void (*DistanceRowKernel)(float, float, const float *, const float *, std::size_t, float *);
+typedef void (*HalfRowKernel)(const float *, std::size_t, uint16_t *);
+
+DistanceRowKernel select_distance_row_kernel()
+{
+#ifdef DISTANCE_ORACLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return distance_row_avx2;
+    }
+#endif
+    return distance_row_scalar;
+}
+
+HalfRowKernel select_half_row_kernel()
+{
+#ifdef DISTANCE_ORACLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+    {
+        return float_row_to_half_f16c;
+    }
+#endif
+    return float_row_to_half_scalar;
+}
+} // namespace
+
+DistanceOracle::DistanceOracle() : backend{DistanceBackend::OnTheFly}, num_nodes{0}, table_data{nullptr}, half_table_data{nullptr}
+{
+}
+
+void DistanceOracle::build(const std::vector<float> &x, const std::vector<float> &y, DistanceBackend backend, std::size_t memory_budget, unsigned int num_threads)
+{
+    this->x = x;
+    this->y = y;
+    num_nodes = x.size();
+
+    if (backend == DistanceBackend::Automatic)
+    {
+        backend = choose_backend(num_nodes, memory_budget);
+    }
+    this->backend = backend;
+
+    table.clear();
+    half_table.clear();
+
+    switch (backend)
+    {
+    case DistanceBackend::Dense:
+        build_dense(num_threads);
+        break;
+    case DistanceBackend::Triangular:
+        build_triangular(num_threads);
+        break;
+    case DistanceBackend::HalfTriangular:
+        build_half_triangular(num_threads);
+        break;
+    default:
+        break;
+    }
+
+    table_data = table.data();
+    half_table_data = half_table.data();
+}
+
+void DistanceOracle::attach(const std::vector<float> &x, const std::vector<float> &y, DistanceBackend backend, const void *table)
+{
+    this->x = x;
+    this->y = y;
+    num_nodes = x.size();
+    this->backend = backend;
+
+    this->table.clear();
+    half_table.clear();
+
+    table_data = backend == DistanceBackend::HalfTriangular ? nullptr : static_cast<const float *>(table);
+    half_table_data = backend == DistanceBackend::HalfTriangular ? static_cast<const uint16_t *>(table) : nullptr;
+}
+
+void DistanceOracle::build_dense(unsigned int num_threads)
+{
+    table = std::vector<float>(num_nodes * num_nodes);
+
+    ThreadPool thread_pool(num_threads);
+    DistanceRowKernel distance_row = select_distance_row_kernel();
+    unsigned int num_blocks = (num_nodes + block_size - 1) / block_size;
+
+    // We first compute the lower triangle, row by row
+    thread_pool.run(num_blocks, [this, distance_row](unsigned int block, unsigned int worker_index) {
+        std::size_t end = std::min(num_nodes, (block + 1) * block_size);
+        for (std::size_t i = block * block_size; i < end; i++)
+        {
+            distance_row(x[i], y[i], x.data(), y.data(), i + 1, table.data() + i * num_nodes);
+        }
+    });
+
+    // Then we mirror it into the upper triangle tile by tile so that both sides stay in cache
+    thread_pool.run(num_blocks, [this, num_blocks](unsigned int block_i, unsigned int worker_index) {
+        std::size_t end_i = std::min(num_nodes, (block_i + 1) * block_size);
+        for (std::size_t block_j = block_i; block_j < num_blocks; block_j++)
+        {
+            std::size_t end_j = std::min(num_nodes, (block_j + 1) * block_size);
+            for (std::size_t i = block_i * block_size; i < end_i; i++)
+            {
+                for (std::size_t j = std::max(i + 1, block_j * block_size); j < end_j; j++)
+                {
+                    table[i * num_nodes + j] = table[j * num_nodes + i];
+                }
+            }
+        }
+    });
+}
+
+void DistanceOracle::build_triangular(unsigned int num_threads)
+{
+    table = std::vector<float>(triangular_index(num_nodes, 0));
+
+    ThreadPool thread_pool(num_threads);
+    DistanceRowKernel distance_row = select_distance_row_kernel();
+    unsigned int num_blocks = (num_nodes + block_size - 1) / block_size;
+
+    thread_pool.run(num_blocks, [this, distance_row](unsigned int block, unsigned int worker_index) {
+        std::size_t end = std::min(num_nodes, (block + 1) * block_size);
+        for (std::size_t i = block * block_size; i < end; i++)
+        {
+            distance_row(x[i], y[i], x.data(), y.data(), i + 1, table.data() + triangular_index(i, 0));
+        }
+    });
+}
+
+void DistanceOracle::build_half_triangular(unsigned int num_threads)
+{
+    half_table = std::vector<uint16_t>(triangular_index(num_nodes, 0));
+
+    ThreadPool thread_pool(num_threads);
+    DistanceRowKernel distance_row = select_distance_row_kernel();
+    HalfRowKernel float_row_to_half = select_half_row_kernel();
+    unsigned int num_blocks = (num_nodes + block_size - 1) / block_size;
+
+    thread_pool.run(num_blocks, [this, distance_row, float_row_to_half](unsigned int block, unsigned int worker_index) {
+        // Every task converts its rows through its own float buffer
+        std::vector<float> row(num_nodes);
+        std::size_t end = std::min(num_nodes, (block + 1) * block_size);
+        for (std::size_t i = block * block_size; i < end; i++)
+        {
+            distance_row(x[i], y[i], x.data(), y.data(), i + 1, row.data());
+            float_row_to_half(row.data(), i + 1, half_table.data() + triangular_index(i, 0));
+        }
+    });
+}
+
+void DistanceOracle::move_node(unsigned int node_id, float x, float y)
+{
+    this->x[node_id] = x;
+    this->y[node_id] = y;
+
+    if (backend == DistanceBackend::OnTheFly)
+    {
+        return;
+    }
+
+    // The row gives the column too, the table stays symmetric
+    std::vector<float> row(num_nodes);
+    select_distance_row_kernel()(x, y, this->x.data(), this->y.data(), num_nodes, row.data());
+
+    for (std::size_t j = 0; j < num_nodes; j++)
+    {
+        switch (backend)
+        {
+        case DistanceBackend::Dense:
+            table[node_id * num_nodes + j] = row[j];
+            table[j * num_nodes + node_id] = row[j];
+            break;
+        case DistanceBackend::Triangular:
+            table[node_id >= j ? triangular_index(node_id, j) : triangular_index(j, node_id)] = row[j];
+            break;
+        default:
+            half_table[node_id >= j ? triangular_index(node_id, j) : triangular_index(j, node_id)] = float_to_half(row[j]);
+            break;
+        }
+    }
+}
+
+std::size_t DistanceOracle::triangular_index(std::size_t i, std::size_t j)
+{
+    // Row i of the lower triangle starts after the i * (i + 1) / 2 entries of the previous rows
+    return i * (i + 1) / 2 + j;
+}
+
+float DistanceOracle::get(unsigned int node_id_i, unsigned int node_id_j) const
+{
+    switch (backend)
+    {
+    case DistanceBackend::Dense:
+        return table_data[node_id_i * num_nodes + node_id_j];
+    case DistanceBackend::Triangular:
+        return node_id_i >= node_id_j ? table_data[triangular_index(node_id_i, node_id_j)] : table_data[triangular_index(node_id_j, node_id_i)];
+    case DistanceBackend::HalfTriangular:
+        return half_to_float(node_id_i >= node_id_j ? half_table_data[triangular_index(node_id_i, node_id_j)] : half_table_data[triangular_index(node_id_j, node_id_i)]);
+    default:
+        return euclidean_distance(x[node_id_i], y[node_id_i], x[node_id_j], y[node_id_j]);
+    }
+}
+
+DistanceBackend DistanceOracle::get_backend() const
+{
+    return backend;
+}
+
+const void *DistanceOracle::get_table() const
+{
+    return backend == DistanceBackend::HalfTriangular ? static_cast<const void *>(half_table_data) : static_cast<const void *>(table_data);
+}
+
+std::size_t DistanceOracle::get_table_size() const
+{
+    return required_memory(num_nodes, backend);
+}
+
+std::size_t DistanceOracle::get_memory_usage() const
+{
+    // An attached table is not counted, it is not owned by the oracle
+    return table.size() * sizeof(float) + half_table.size() * sizeof(uint16_t) + (x.size() + y.size()) * sizeof(float);
+}
+
+DistanceBackend DistanceOracle::choose_backend(std::size_t num_nodes, std::size_t memory_budget)
+{
+    for (auto backend : {DistanceBackend::Dense, DistanceBackend::Triangular, DistanceBackend::HalfTriangular})
+    {
+        if (required_memory(num_nodes, backend) <= memory_budget)
+        {
+            return backend;
+        }
+    }
+
+    return DistanceBackend::OnTheFly;
+}
+
+std::size_t DistanceOracle::required_memory(std::size_t num_nodes, DistanceBackend backend)
+{
+    switch (backend)
+    {
+    case DistanceBackend::Dense:
+        return num_nodes * num_nodes * sizeof(float);
+    case DistanceBackend::Triangular:
+        return triangular_index(num_nodes, 0) * sizeof(float);
+    case DistanceBackend::HalfTriangular:
+        return triangular_index(num_nodes, 0) * sizeof(uint16_t);
+    default:
+        return 0;
+    }
+}
+
+const char *DistanceOracle::backend_name(DistanceBackend backend)
+{
+    switch (backend)
+    {
+    case DistanceBackend::Dense:
+        return "dense";
+    case DistanceBackend::Triangular:
+        return "triangular";
+    case DistanceBackend::HalfTriangular:
+        return "half";
+    case DistanceBackend::OnTheFly:
+        return "on-the-fly";
+    default:
+        return "auto";
+    }
+}
+
+bool DistanceOracle::parse_backend(const std::string &name, DistanceBackend &backend)
+{
+    for (auto candidate : {DistanceBackend::Dense, DistanceBackend::Triangular, DistanceBackend::HalfTriangular, DistanceBackend::OnTheFly, DistanceBackend::Automatic})
+    {
+        if (name == backend_name(candidate))
+        {
+            backend = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+enum class DistanceBackend
+{
+    Dense,          // full n x n float matrix
+    Triangular,     // lower triangle of floats, half the memory of Dense
+    HalfTriangular, // lower triangle of half precision floats (about 3 significant digits)
+    OnTheFly,       // no table, the distance is computed from the coordinates
+    Automatic       // the most precomputed backend that fits in the memory budget
+};
+
+// Answers the euclidean distance between two nodes from one of several storage backends
+// The coordinates are always kept as structure of arrays, which is all the OnTheFly backend needs
+class DistanceOracle
+{
+private:
+    DistanceBackend backend;
+    std::size_t num_nodes;
+
+    std::vector<float> x;
+    std::vector<float> y;
+
+    std::vector<float> table;
+    std::vector<uint16_t> half_table;
+
+    // The table read by get, it points either into the vectors above or into a table owned by someone else
+    const float *table_data;
+    const uint16_t *half_table_data;
+
+    void build_dense(unsigned int num_threads);
+    void build_triangular(unsigned int num_threads);
+    void build_half_triangular(unsigned int num_threads);
+
+    static std::size_t triangular_index(std::size_t i, std::size_t j);
+
+public:
+    DistanceOracle();
+
+    // The table pointers would dangle in a copy, moving keeps the buffers of the vectors
+    DistanceOracle(const DistanceOracle &) = delete;
+    DistanceOracle &operator=(const DistanceOracle &) = delete;
+    DistanceOracle(DistanceOracle &&) = default;
+    DistanceOracle &operator=(DistanceOracle &&) = default;
+
+    // Builds the tables for the given coordinates, with num_threads threads
+    void build(const std::vector<float> &x, const std::vector<float> &y, DistanceBackend backend, std::size_t memory_budget, unsigned int num_threads);
+
+    // Uses a table built beforehand (e.g. in a memory mapped instance cache) instead of building one
+    // The table must have the layout of the backend and outlive the oracle
+    void attach(const std::vector<float> &x, const std::vector<float> &y, DistanceBackend backend, const void *table);
+
+    float get(unsigned int node_id_i, unsigned int node_id_j) const;
+
+    // Moves one node and computes its row and column again, in O(num_nodes)
+    // The table must have been built, an attached table is read only
+    void move_node(unsigned int node_id, float x, float y);
+
+    // The raw table in the layout of the backend, nullptr for OnTheFly
+    const void *get_table() const;
+    std::size_t get_table_size() const;
+
+    DistanceBackend get_backend() const;
+    std::size_t get_memory_usage() const;
+
+    // Picks the backend keeping the most distances precomputed within memory_budget bytes
+    static DistanceBackend choose_backend(std::size_t num_nodes, std::size_t memory_budget);
+    static std::size_t required_memory(std::size_t num_nodes, DistanceBackend backend);
+    static const char *backend_name(DistanceBackend backend);
+    static bool parse_backend(const std::string &name, DistanceBackend &backend);
+};
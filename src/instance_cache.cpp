@@ -0,0 +1,72 @@
+#include "instance_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filepath) : data{nullptr}, size{0}
+{
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Can't open " + filepath);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Can't read " + filepath);
+    }
+    size = file_stat.st_size;
+
+    // A shared mapping lets every process solving this instance use the same pages of the page cache
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid once the descriptor is closed
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Can't map " + filepath);
+    }
+    data = static_cast<const char *>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<char *>(data), size);
+}
+
+const char *MappedFile::get_data() const
+{
+    return data;
+}
+
+std::size_t MappedFile::get_size() const
+{
+    return size;
+}
+
+const char *MappedFile::get_section(uint64_t offset, uint64_t section_size) const
+{
+    if (offset > size || section_size > size - offset)
+    {
+        return nullptr;
+    }
+
+    return data + offset;
+}
+
+bool is_instance_cache(const std::string &filepath)
+{
+    char magic[sizeof(instance_cache_magic)] = {};
+    std::ifstream file(filepath, std::ios::binary);
+    file.read(magic, sizeof(magic));
+
+    return file && std::memcmp(magic, instance_cache_magic, sizeof(magic)) == 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Binary file holding an instance already parsed and scaled, and optionally its distance table
+// It is written by Problem::write_cache and mapped read-only by the Problem constructor,
+// so the processes solving the same instance share its pages and nothing is parsed at startup
+//
+// Layout : the header, then the sections at the offsets given by the header (8 bytes aligned)
+//  - the dataset name
+//  - x, y, service_time, available_time (float), demand (int32), ready_time and due_date (float) of every node,
+//    depot duplicates included
+//  - the distance table in the layout of distance_backend, when it is not on-the-fly
+struct InstanceCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    // The values are scaled for this day length, the cache can't be used with another one
+    uint32_t t_wd;
+
+    uint32_t num_customers;
+    uint32_t num_vehicles;
+    uint32_t vehicle_capacity;
+    float scaling_factor;
+    // Nodes in the arrays, the padding node 0 and the depot duplicates included
+    uint32_t num_nodes;
+    // A DistanceBackend, OnTheFly when no table is stored
+    uint32_t distance_backend;
+
+    uint64_t dataset_name_offset;
+    uint64_t dataset_name_size;
+    uint64_t x_offset;
+    uint64_t y_offset;
+    uint64_t service_time_offset;
+    uint64_t available_time_offset;
+    uint64_t demand_offset;
+    uint64_t ready_time_offset;
+    uint64_t due_date_offset;
+    uint64_t distances_offset;
+    uint64_t distances_size;
+};
+
+const char instance_cache_magic[8] = {'D', 'V', 'R', 'P', 'B', 'I', 'N', '\0'};
+const uint32_t instance_cache_version = 2;
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+private:
+    const char *data;
+    std::size_t size;
+
+public:
+    MappedFile(const std::string &filepath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *get_data() const;
+    std::size_t get_size() const;
+
+    // Returns nullptr if the section doesn't fit in the file
+    const char *get_section(uint64_t offset, uint64_t section_size) const;
+};
+
+// Whether the file starts with the magic of an instance cache
+bool is_instance_cache(const std::string &filepath);
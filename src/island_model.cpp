@@ -0,0 +1,162 @@
+#include "island_model.h"
+#include "random_generator.h"
+
+IslandModel::IslandModel(Problem *problem, const std::vector<IslandParameters> &islands_parameters, const IslandModelOptions &options) : problem{problem}, migration_interval{options.migration_interval}, num_steps{0}, best_island{0}, thread_pool{(unsigned int)islands_parameters.size()}
+{
+    // The islands are the parallelism, each colony constructs its ants on its island's thread
+    for (auto island = 0; island < islands_parameters.size(); island++)
+    {
+        const IslandParameters &parameters = islands_parameters[island];
+
+        AntColonyOptions island_options = options.ant_colony_options;
+        island_options.num_threads = 1;
+        island_options.seed = RandomGenerator::derive_seed(options.ant_colony_options.seed, 0, island);
+
+        islands.push_back(std::unique_ptr<AntColony>(new AntColony(problem, parameters.num_ants, parameters.alpha, parameters.beta, parameters.q_0, parameters.rho, island_options)));
+    }
+
+    find_best_island();
+}
+
+void IslandModel::step()
+{
+    thread_pool.run(islands.size(), [this](unsigned int island, unsigned int worker_index) {
+        islands[island]->step();
+    });
+    num_steps++;
+
+    if (migration_interval > 0 && num_steps % migration_interval == 0)
+    {
+        migrate();
+    }
+
+    find_best_island();
+}
+
+void IslandModel::migrate()
+{
+    // We snapshot the best solutions first so that a solution moves by one island per migration
+    std::vector<std::vector<TourAtom>> migrants;
+    std::vector<float> migrants_scores;
+    for (auto &island : islands)
+    {
+        migrants.push_back(island->get_best_solution());
+        migrants_scores.push_back(island->get_best_solution_score());
+    }
+
+    for (auto island = 0; island < islands.size(); island++)
+    {
+        unsigned int previous_island = (island + islands.size() - 1) % islands.size();
+        islands[island]->offer_solution(migrants[previous_island], migrants_scores[previous_island]);
+    }
+}
+
+void IslandModel::find_best_island()
+{
+    // An island which serves every customer beats one which doesn't, whatever their scores
+    for (auto island = 0; island < islands.size(); island++)
+    {
+        bool complete = islands[island]->is_best_solution_complete();
+        bool best_complete = islands[best_island]->is_best_solution_complete();
+        if (complete != best_complete ? complete : islands[island]->get_best_solution_score() < islands[best_island]->get_best_solution_score())
+        {
+            best_island = island;
+        }
+    }
+}
+
+void IslandModel::update_solution()
+{
+    // Every island must take the new customers into account, the best one is found again afterwards
+    thread_pool.run(islands.size(), [this](unsigned int island, unsigned int worker_index) {
+        islands[island]->update_solution();
+    });
+
+    best_island = 0;
+    find_best_island();
+}
+
+void IslandModel::remove_rejected_customers()
+{
+    // Each island may still serve some of the rejected customers in its own best solution
+    for (auto &island : islands)
+    {
+        island->remove_rejected_customers();
+    }
+
+    best_island = 0;
+    find_best_island();
+}
+
+void IslandModel::synchronize_local_search()
+{
+    for (auto &island : islands)
+    {
+        island->synchronize_local_search();
+    }
+
+    find_best_island();
+}
+
+const std::vector<TourAtom> &IslandModel::get_best_solution() const
+{
+    return islands[best_island]->get_best_solution();
+}
+
+float IslandModel::get_best_solution_score() const
+{
+    return islands[best_island]->get_best_solution_score();
+}
+
+bool IslandModel::is_best_solution_complete() const
+{
+    return islands[best_island]->is_best_solution_complete();
+}
+
+unsigned int IslandModel::get_num_islands() const
+{
+    return islands.size();
+}
+
+const AntColony &IslandModel::get_island(unsigned int island) const
+{
+    return *islands[island];
+}
+
+ColonyStatistics IslandModel::get_statistics() const
+{
+    ColonyStatistics statistics;
+    for (auto &island : islands)
+    {
+        const ColonyStatistics &island_statistics = island->get_statistics();
+        statistics.num_steps += island_statistics.num_steps;
+        statistics.num_ants_built += island_statistics.num_ants_built;
+        statistics.num_ants_stuck += island_statistics.num_ants_stuck;
+        statistics.num_moves += island_statistics.num_moves;
+        statistics.num_candidates += island_statistics.num_candidates;
+        statistics.construction_time += island_statistics.construction_time;
+        statistics.pheromon_update_time += island_statistics.pheromon_update_time;
+        statistics.local_search_time += island_statistics.local_search_time;
+        statistics.num_local_search_moves += island_statistics.num_local_search_moves;
+        statistics.num_inserted_customers += island_statistics.num_inserted_customers;
+        statistics.num_rebuild_attempts += island_statistics.num_rebuild_attempts;
+    }
+
+    return statistics;
+}
+
+void IslandModel::reset_statistics()
+{
+    for (auto &island : islands)
+    {
+        island->reset_statistics();
+    }
+}
+
+void IslandModel::set_measure_timings(bool measure_timings)
+{
+    for (auto &island : islands)
+    {
+        island->set_measure_timings(measure_timings);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "problem.h"
+#include "ant_colony.h"
+#include "thread_pool.h"
+#include "tour_atom.h"
+
+// Parameters of the ACS run by one island
+struct IslandParameters
+{
+    unsigned int num_ants = 10;
+    float alpha = 1;
+    float beta = 1;
+    float q_0 = 0.9;
+    float rho = 0.1;
+};
+
+struct IslandModelOptions
+{
+    // Options of every colony, the seed is the master seed the islands derive theirs from
+    AntColonyOptions ant_colony_options;
+    // Every that many steps, each island receives the best solution of the previous one (ring), 0 disables migrations
+    unsigned int migration_interval = 50;
+};
+
+// Several independent colonies (islands) optimizing the same problem, each with its own pheromons, seed
+// and parameters, so that they explore different regions instead of converging together.
+// A step steps every island once, one island per thread ; the problem is only read during a step.
+// The best solution of the model is the best one across the islands.
+// The islands are stepped and migrate in a fixed order, so a run is reproducible for a given seed.
+class IslandModel
+{
+private:
+    Problem *problem;
+    std::vector<std::unique_ptr<AntColony>> islands;
+    unsigned int migration_interval;
+    unsigned long num_steps;
+    unsigned int best_island;
+
+    ThreadPool thread_pool;
+
+    void migrate();
+    void find_best_island();
+
+public:
+    IslandModel(Problem *problem, const std::vector<IslandParameters> &islands_parameters, const IslandModelOptions &options);
+
+    void step();
+    void update_solution();
+    void remove_rejected_customers();
+    void synchronize_local_search();
+
+    const std::vector<TourAtom> &get_best_solution() const;
+    float get_best_solution_score() const;
+    bool is_best_solution_complete() const;
+    unsigned int get_num_islands() const;
+    const AntColony &get_island(unsigned int island) const;
+
+    // The statistics are summed over the islands, so are the timings
+    ColonyStatistics get_statistics() const;
+    void reset_statistics();
+    void set_measure_timings(bool measure_timings);
+};
@@ -1,204 +1,685 @@
-#include "Local_search.h"
+#include "local_search.h"
 #include <vector>
-#include <iostream>
-#include <cmath>
+#include <algorithm>
+#include <limits>
 
+namespace
+{
+const unsigned int no_route = std::numeric_limits<unsigned int>::max();
+// Smaller gains are rounding noise, applying them could make the search cycle
+const float min_gain = 1e-4f;
+}
 
-double ls_elapsed_since(const std::chrono::high_resolution_clock::time_point& time)
+Local_search::Local_search(const Problem& problem, const std::vector<TourAtom>& solution) : problem{ problem }
 {
-	auto now = std::chrono::high_resolution_clock::now();
-	std::chrono::duration<double> elapsed = now - time;
+	unsigned int num_nodes = problem.get_num_nodes() + 1;
+	node_routes = std::vector<unsigned int>(num_nodes, no_route);
+	node_positions = std::vector<unsigned int>(num_nodes, 0);
+	dont_look_bits = std::vector<bool>(num_nodes, true);
+
+	// Every depot starts a new route
+	for (auto& tour_atom : solution) {
+		if (problem.is_node_depot(tour_atom.node_id) || routes.empty()) {
+			routes.push_back({});
+		}
+		routes.back().push_back(tour_atom.node_id);
+	}
+
+	prefix_loads.resize(routes.size());
+	prefix_distances.resize(routes.size());
+	service_starts.resize(routes.size());
+	forward_slacks.resize(routes.size());
+	first_movable_positions.resize(routes.size());
 
-	return elapsed.count();
+	for (unsigned int route = 0; route < routes.size(); route++) {
+		// The committed customers come right after the depot
+		unsigned int position = 1;
+		while (position < routes[route].size() && problem.has_c_node_been_committed(routes[route][position])) {
+			position++;
+		}
+		first_movable_positions[route] = position;
+
+		compute_route(route);
+	}
+
+	// Every movable customer is looked at once, in the order of the solution
+	for (auto route = routes.size(); route-- > 0;) {
+		for (auto position = routes[route].size(); position-- > first_movable_positions[route];) {
+			dont_look_bits[routes[route][position]] = false;
+			active_nodes_ids.push_back(routes[route][position]);
+		}
+	}
 }
 
-Local_search::Local_search(const Problem& p_problem, std::vector<TourAtom>& p_solution) : problem{ p_problem }, solution{ p_solution }
+void Local_search::compute_route(unsigned int route)
 {
-	std::vector<TourAtom> current_vector_vehicle;
+	const std::vector<unsigned int>& nodes_ids = routes[route];
+	prefix_loads[route].resize(nodes_ids.size());
+	prefix_distances[route].resize(nodes_ids.size());
 
-	for (auto it = p_solution.begin(); it != p_solution.end(); it++) {
-		if (p_problem.is_node_depot(it->node_id)) {
-			current_vector_vehicle.push_back(*it);
-			if ( current_vector_vehicle.size() > 1) {
-				solution_vehicle.push_back(current_vector_vehicle);
-				current_vector_vehicle.clear(); 
-				current_vector_vehicle.push_back(*it);
-			}
+	int load = 0;
+	float distance = 0;
+	for (unsigned int position = 0; position < nodes_ids.size(); position++) {
+		if (position > 0) {
+			load += problem.get_customer_demand(nodes_ids[position]);
+			distance += problem.get_distance(nodes_ids[position - 1], nodes_ids[position]);
 		}
-		else {
-			current_vector_vehicle.push_back(*it);
+		prefix_loads[route][position] = load;
+		prefix_distances[route][position] = distance;
+		node_routes[nodes_ids[position]] = route;
+		node_positions[nodes_ids[position]] = position;
+	}
+
+	if (!problem.has_time_windows()) {
+		return;
+	}
+
+	// The waiting time at each position is kept in forward_slacks until the backward pass turns it into the slack
+	std::vector<float>& starts = service_starts[route];
+	std::vector<float>& slacks = forward_slacks[route];
+	starts.resize(nodes_ids.size());
+	slacks.resize(nodes_ids.size());
+
+	starts[0] = 0;
+	slacks[0] = 0;
+	for (unsigned int position = 1; position < nodes_ids.size(); position++) {
+		if (position < first_movable_positions[route]) {
+			starts[position] = problem.get_commitment_end_of_service(nodes_ids[position]) - problem.get_customer_service_time(nodes_ids[position]);
+			slacks[position] = 0;
+			continue;
 		}
+		float arrival_time = departure_time(route, position - 1) + problem.get_distance(nodes_ids[position - 1], nodes_ids[position]);
+		starts[position] = service_start_time(nodes_ids[position], arrival_time);
+		slacks[position] = starts[position] - arrival_time;
 	}
-	// We add the last vehicle clients since it didn't end with a depot
-	solution_vehicle.push_back(current_vector_vehicle);
-	current_vector_vehicle.clear();
 
+	float next_slack = std::numeric_limits<float>::infinity();
+	for (auto position = nodes_ids.size(); position-- > 0;) {
+		float waiting_time = slacks[position];
+		slacks[position] = std::min(problem.get_customer_due_date(nodes_ids[position]) - starts[position], next_slack);
+		next_slack = waiting_time + slacks[position];
+	}
 }
-int Local_search::calculate_remaining_demand(unsigned int to_touratom_position, unsigned int vehicle_position)
+
+bool Local_search::has_node(unsigned int route, unsigned int position) const
 {
-	int demand = 0;
-	for (int i = to_touratom_position; i < solution_vehicle[vehicle_position].size(); i++) {
-		demand += problem.get_customer_demand(solution_vehicle[vehicle_position][i].node_id);
-	}
-	return demand;
+	return position < routes[route].size();
 }
 
-int Local_search::calculate_capacity_left_before(unsigned int to_touratom_position, unsigned int vehicle_position) 
+unsigned int Local_search::node_at(unsigned int route, unsigned int position) const
 {
-	int capacity_left = problem.get_vehicle_capacity();
-	for (int i = 0; i < to_touratom_position-1; i++) {
-		capacity_left -= problem.get_customer_demand(solution_vehicle[vehicle_position][i].node_id);
-	}
-	return capacity_left;
+	return routes[route][position];
 }
 
-float Local_search::inter_vehicle_path_length_difference(unsigned int to_touratom_position_in_vehicle1, unsigned int vehicle1_position, unsigned int to_touratom_position_in_vehicle2, unsigned int vehicle2_position)
+float Local_search::arc_distance(unsigned int route, unsigned int position) const
 {
-	float path1 = problem.get_distance(solution_vehicle[vehicle1_position][to_touratom_position_in_vehicle1 - 1].node_id, solution_vehicle[vehicle1_position][to_touratom_position_in_vehicle1].node_id);
-	float path2 = problem.get_distance(solution_vehicle[vehicle2_position][to_touratom_position_in_vehicle2 - 1].node_id, solution_vehicle[vehicle2_position][to_touratom_position_in_vehicle2].node_id);
-	
-	float path1_cross = problem.get_distance(solution_vehicle[vehicle1_position][to_touratom_position_in_vehicle1 - 1].node_id, solution_vehicle[vehicle2_position][to_touratom_position_in_vehicle2].node_id);
-	float path2_cross = problem.get_distance(solution_vehicle[vehicle2_position][to_touratom_position_in_vehicle2 - 1].node_id, solution_vehicle[vehicle1_position][to_touratom_position_in_vehicle1].node_id);
-	
-	return path1_cross + path2_cross - path1 - path2;
+	// The arc leaving position ; the last node of a route has none since the routes are open
+	if (!has_node(route, position + 1)) {
+		return 0;
+	}
+	return prefix_distances[route][position + 1] - prefix_distances[route][position];
 }
 
-float Local_search::intra_path_length_difference(unsigned int touratom_position1, unsigned int touratom_position2, unsigned int vehicle_position)
+void Local_search::evaluate_relocate(unsigned int route_1, unsigned int begin, unsigned int end, unsigned int route_2, unsigned int position, bool reversed, Move& best_move) const
 {
-	unsigned int tour_atom_pos1_id = solution_vehicle[vehicle_position][touratom_position1].node_id;
-	unsigned int tour_atom_pos1_prev_id = solution_vehicle[vehicle_position][touratom_position1-1].node_id;
-	unsigned int tour_atom_pos1_next_id = solution_vehicle[vehicle_position][touratom_position1 + 1].node_id;
-	unsigned int tour_atom_pos2_id = solution_vehicle[vehicle_position][touratom_position2].node_id;
-	unsigned int tour_atom_pos2_prev_id = solution_vehicle[vehicle_position][touratom_position2 - 1].node_id;
-	unsigned int tour_atom_pos2_next_id = solution_vehicle[vehicle_position][touratom_position2 + 1].node_id;
-	float path_diff;
-	int path_position_diff = touratom_position2 - touratom_position1;
-	if (abs(path_position_diff) < 2) {
-		path_diff = -problem.get_distance(tour_atom_pos1_prev_id, tour_atom_pos1_id) - problem.get_distance(tour_atom_pos1_id, tour_atom_pos2_id) -
-			problem.get_distance(tour_atom_pos2_id, tour_atom_pos2_next_id) + problem.get_distance(tour_atom_pos2_prev_id, tour_atom_pos2_id) +
-			problem.get_distance(tour_atom_pos2_id, tour_atom_pos1_id) + problem.get_distance(tour_atom_pos1_id, tour_atom_pos2_next_id);
+	// The segment [begin, end] of route_1 goes between position and position + 1 of route_2
+	if (begin < first_movable_positions[route_1] || end < begin || !has_node(route_1, end) || end - begin >= max_segment_length) {
+		return;
 	}
-	else {
-		path_diff = -problem.get_distance(tour_atom_pos1_prev_id, tour_atom_pos1_id) - problem.get_distance(tour_atom_pos1_id, tour_atom_pos1_next_id) -
-			problem.get_distance(tour_atom_pos2_prev_id, tour_atom_pos2_id) - problem.get_distance(tour_atom_pos2_id, tour_atom_pos2_next_id) +
-			problem.get_distance(tour_atom_pos1_prev_id, tour_atom_pos2_id) + problem.get_distance(tour_atom_pos2_id, tour_atom_pos1_next_id) +
-			problem.get_distance(tour_atom_pos2_prev_id, tour_atom_pos1_id) + problem.get_distance(tour_atom_pos1_id, tour_atom_pos2_next_id);
+	if (position + 1 < first_movable_positions[route_2] || !has_node(route_2, position)) {
+		return;
 	}
-	return path_diff;
-}
+	if (route_1 == route_2 && position + 1 >= begin && position <= end) {
+		return;
+	}
+
+	// The load of route_1 only decreases, the one of route_2 must stay within the capacity
+	if (route_1 != route_2) {
+		int segment_load = prefix_loads[route_1][end] - prefix_loads[route_1][begin - 1];
+		if (prefix_loads[route_2].back() + segment_load > (int)problem.get_vehicle_capacity()) {
+			return;
+		}
+	}
+
+	unsigned int before_id = node_at(route_1, begin - 1);
+	unsigned int begin_id = node_at(route_1, begin);
+	unsigned int end_id = node_at(route_1, end);
 
+	float removal_gain = arc_distance(route_1, begin - 1) + arc_distance(route_1, end);
+	if (has_node(route_1, end + 1)) {
+		removal_gain -= problem.get_distance(before_id, node_at(route_1, end + 1));
+	}
+
+	unsigned int first_id = reversed ? end_id : begin_id;
+	unsigned int last_id = reversed ? begin_id : end_id;
+	unsigned int position_id = node_at(route_2, position);
+
+	float insertion_cost = problem.get_distance(position_id, first_id);
+	if (has_node(route_2, position + 1)) {
+		unsigned int next_id = node_at(route_2, position + 1);
+		insertion_cost += problem.get_distance(last_id, next_id) - problem.get_distance(position_id, next_id);
+	}
+
+	Move move;
+	move.type = Move::Relocate;
+	move.gain = removal_gain - insertion_cost;
+	move.route_1 = route_1;
+	move.route_2 = route_2;
+	move.begin = begin;
+	move.end = end;
+	move.position = position;
+	move.reversed = reversed;
+	consider_move(move, best_move);
+}
 
-void Local_search::inter_vehicle_swap( unsigned int to_touratom_position_in_vehicle1, unsigned int vehicle1_position, unsigned int to_touratom_position_in_vehicle2, unsigned int vehicle2_position)
+void Local_search::evaluate_two_opt(unsigned int route, unsigned int begin, unsigned int end, Move& best_move) const
 {
-	// copy end path 1 
-	std::vector<TourAtom> copy_end_vehicle1;
+	// The segment [begin, end] is reversed ; the distances are symmetric so only the arcs at its ends change
+	if (begin < first_movable_positions[route] || end <= begin || !has_node(route, end)) {
+		return;
+	}
+
+	unsigned int before_id = node_at(route, begin - 1);
+	unsigned int begin_id = node_at(route, begin);
+	unsigned int end_id = node_at(route, end);
 
-	for (int i = to_touratom_position_in_vehicle1; i < solution_vehicle[vehicle1_position].size(); i++) {
-		//copy_end_vehicle1.push_back(solution_vehicle[vehicle_path1_idx][i]);
-		copy_end_vehicle1.push_back(
-			TourAtom(solution_vehicle[vehicle1_position][i].node_id,
-				solution_vehicle[vehicle1_position][i].load,
-				solution_vehicle[vehicle1_position][i].end_of_service,
-				solution_vehicle[vehicle1_position][i].distance));
+	float gain = arc_distance(route, begin - 1) + arc_distance(route, end) - problem.get_distance(before_id, end_id);
+	if (has_node(route, end + 1)) {
+		gain -= problem.get_distance(begin_id, node_at(route, end + 1));
 	}
 
-	int size = solution_vehicle[vehicle1_position].size();
-	// Delete nodes in path 1 that begin at swap node
-	while (solution_vehicle[vehicle1_position].size() - 1 >= to_touratom_position_in_vehicle1) {
-		solution_vehicle[vehicle1_position].pop_back();
+	Move move;
+	move.type = Move::TwoOpt;
+	move.gain = gain;
+	move.route_1 = route;
+	move.route_2 = route;
+	move.begin = begin;
+	move.end = end;
+	consider_move(move, best_move);
+}
+
+void Local_search::evaluate_two_opt_star(unsigned int route_1, unsigned int position_1, unsigned int route_2, unsigned int position_2, Move& best_move) const
+{
+	// The tails after position_1 and position_2 are exchanged
+	if (route_1 == route_2 || position_1 + 1 < first_movable_positions[route_1] || position_2 + 1 < first_movable_positions[route_2]) {
+		return;
+	}
+	if (!has_node(route_1, position_1) || !has_node(route_2, position_2)) {
+		return;
 	}
-	// Add ends nodes from path 2 to path 1
-	for (int i = to_touratom_position_in_vehicle2; i < solution_vehicle[vehicle2_position].size(); i++) {
-		solution_vehicle[vehicle1_position].push_back(solution_vehicle[vehicle2_position][i]);
+
+	int tail_load_1 = prefix_loads[route_1].back() - prefix_loads[route_1][position_1];
+	int tail_load_2 = prefix_loads[route_2].back() - prefix_loads[route_2][position_2];
+	int capacity = problem.get_vehicle_capacity();
+	if (prefix_loads[route_1][position_1] + tail_load_2 > capacity || prefix_loads[route_2][position_2] + tail_load_1 > capacity) {
+		return;
 	}
-	update_tour_atom_values(to_touratom_position_in_vehicle1, vehicle1_position);
-	// Delete nodes in path 2 that begin at swap node
-	while (solution_vehicle[vehicle2_position].size() -1 >= to_touratom_position_in_vehicle2 ) {
-		solution_vehicle[vehicle2_position].pop_back();
+
+	float gain = arc_distance(route_1, position_1) + arc_distance(route_2, position_2);
+	if (has_node(route_2, position_2 + 1)) {
+		gain -= problem.get_distance(node_at(route_1, position_1), node_at(route_2, position_2 + 1));
 	}
-	// adds end of path1 to path 2
-	for (auto it = copy_end_vehicle1.begin(); it != copy_end_vehicle1.end(); it++) {
-		solution_vehicle[vehicle2_position].push_back(*it);
+	if (has_node(route_1, position_1 + 1)) {
+		gain -= problem.get_distance(node_at(route_2, position_2), node_at(route_1, position_1 + 1));
 	}
-	update_tour_atom_values(to_touratom_position_in_vehicle2, vehicle2_position);
+
+	Move move;
+	move.type = Move::TwoOptStar;
+	move.gain = gain;
+	move.route_1 = route_1;
+	move.route_2 = route_2;
+	move.begin = position_1;
+	move.position = position_2;
+	consider_move(move, best_move);
 }
 
-void Local_search::intra_vehicle_swap(unsigned int touratom_position1, unsigned int touratom_position2, unsigned int vehicle_position)
+void Local_search::consider_move(const Move& move, Move& best_move) const
 {
-	unsigned int tour_atom_pos1_id = solution_vehicle[vehicle_position][touratom_position1].node_id;
-	solution_vehicle[vehicle_position][touratom_position1].node_id = solution_vehicle[vehicle_position][touratom_position2].node_id;
-	solution_vehicle[vehicle_position][touratom_position2].node_id = tour_atom_pos1_id;
-	update_tour_atom_values(touratom_position1, vehicle_position);
+	// The time windows are only checked for the moves that would be kept
+	if (move.gain > best_move.gain && (!problem.has_time_windows() || move_fits_time_windows(move))) {
+		best_move = move;
+	}
 }
 
-int Local_search::search(int t_ls) {
-	auto time_0 = std::chrono::high_resolution_clock::now();
-	for (int vehicle_i_idx = 1; vehicle_i_idx < solution_vehicle.size() ; vehicle_i_idx++) {
-		for (int vehicle_j_idx = 1; vehicle_j_idx < solution_vehicle.size() ; vehicle_j_idx++) {
-			if (vehicle_i_idx != vehicle_j_idx) {
-				for (int node_k_idx = 1; node_k_idx < solution_vehicle[vehicle_i_idx].size() - 1; node_k_idx++) {
-					for (int node_l_idx = 1; node_l_idx < solution_vehicle[vehicle_j_idx].size() - 1; node_l_idx++) {
-						if (!problem.has_c_node_been_committed(solution_vehicle[vehicle_i_idx][node_k_idx].node_id) && !problem.has_c_node_been_committed(solution_vehicle[vehicle_j_idx][node_l_idx].node_id)) {
-							if (calculate_capacity_left_before(node_k_idx, vehicle_i_idx) >= calculate_remaining_demand(node_l_idx, vehicle_j_idx) && calculate_capacity_left_before(node_l_idx, vehicle_j_idx) >= calculate_remaining_demand(node_k_idx, vehicle_i_idx)) {
-								if (inter_vehicle_path_length_difference(node_k_idx, vehicle_i_idx, node_l_idx, vehicle_j_idx) < 0) {
-									inter_vehicle_swap(node_k_idx, vehicle_i_idx, node_l_idx, vehicle_j_idx);
-									if (ls_elapsed_since(time_0) > t_ls) {
-										return 0;
-									};
-								}
-							}
-						}
+float Local_search::service_start_time(unsigned int node_id, float arrival_time) const
+{
+	return problem.has_time_windows() ? std::max(arrival_time, problem.get_customer_ready_time(node_id)) : arrival_time;
+}
+
+float Local_search::departure_time(unsigned int route, unsigned int position) const
+{
+	float end_of_service = service_starts[route][position] + problem.get_customer_service_time(routes[route][position]);
+	return position + 1 == first_movable_positions[route] ? problem.get_departure_time(end_of_service) : end_of_service;
+}
+
+bool Local_search::move_fits_time_windows(const Move& move) const
+{
+	switch (move.type) {
+	case Move::Relocate:
+		if (move.route_1 != move.route_2) {
+			// Removing the segment can only make the rest of route_1 earlier
+			return insertion_fits_time_windows(move.route_2, move.position, &routes[move.route_1][move.begin], move.end - move.begin + 1, move.reversed);
+		}
+		else {
+			const std::vector<unsigned int>& nodes_ids = routes[move.route_1];
+			std::vector<unsigned int> moved_nodes_ids;
+			moved_nodes_ids.reserve(nodes_ids.size());
+			for (unsigned int position = 0; position < nodes_ids.size(); position++) {
+				if (position < move.begin || position > move.end) {
+					moved_nodes_ids.push_back(nodes_ids[position]);
+				}
+				if (position == move.position) {
+					if (move.reversed) {
+						moved_nodes_ids.insert(moved_nodes_ids.end(), nodes_ids.rbegin() + (nodes_ids.size() - 1 - move.end), nodes_ids.rbegin() + (nodes_ids.size() - move.begin));
+					}
+					else {
+						moved_nodes_ids.insert(moved_nodes_ids.end(), nodes_ids.begin() + move.begin, nodes_ids.begin() + move.end + 1);
 					}
 				}
 			}
+			return route_fits_time_windows(move.route_1, moved_nodes_ids);
+		}
+	case Move::TwoOpt:
+	{
+		std::vector<unsigned int> moved_nodes_ids = routes[move.route_1];
+		std::reverse(moved_nodes_ids.begin() + move.begin, moved_nodes_ids.begin() + move.end + 1);
+		return route_fits_time_windows(move.route_1, moved_nodes_ids);
+	}
+	case Move::TwoOptStar:
+		return tail_fits_time_windows(move.route_1, move.begin, move.route_2, move.position) &&
+			tail_fits_time_windows(move.route_2, move.position, move.route_1, move.begin);
+	default:
+		return false;
+	}
+}
+
+bool Local_search::insertion_fits_time_windows(unsigned int route, unsigned int position, const unsigned int* nodes_ids, unsigned int num_nodes, bool reversed) const
+{
+	// The nodes are served in their new order, then the delay they cause to the next node must fit in its forward slack
+	unsigned int previous_id = node_at(route, position);
+	float end_of_service = departure_time(route, position);
+
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		unsigned int node_id = nodes_ids[reversed ? num_nodes - 1 - i : i];
+		float arrival_time = end_of_service + problem.get_distance(previous_id, node_id);
+		if (arrival_time > problem.get_customer_due_date(node_id)) {
+			return false;
+		}
+		end_of_service = service_start_time(node_id, arrival_time) + problem.get_customer_service_time(node_id);
+		previous_id = node_id;
+	}
+
+	if (!has_node(route, position + 1)) {
+		return true;
+	}
+	unsigned int next_id = node_at(route, position + 1);
+	float delay = service_start_time(next_id, end_of_service + problem.get_distance(previous_id, next_id)) - service_starts[route][position + 1];
+	return delay <= forward_slacks[route][position + 1];
+}
+
+bool Local_search::tail_fits_time_windows(unsigned int route_1, unsigned int position_1, unsigned int route_2, unsigned int position_2) const
+{
+	// The tail of route_2 after position_2 is served right after position_1 of route_1
+	if (!has_node(route_2, position_2 + 1)) {
+		return true;
+	}
+
+	unsigned int previous_id = node_at(route_1, position_1);
+	unsigned int next_id = node_at(route_2, position_2 + 1);
+	float end_of_service = departure_time(route_1, position_1);
+	float delay = service_start_time(next_id, end_of_service + problem.get_distance(previous_id, next_id)) - service_starts[route_2][position_2 + 1];
+	return delay <= forward_slacks[route_2][position_2 + 1];
+}
+
+bool Local_search::route_fits_time_windows(unsigned int route, const std::vector<unsigned int>& nodes_ids) const
+{
+	unsigned int first_position = first_movable_positions[route];
+	float end_of_service = departure_time(route, first_position - 1);
+	for (unsigned int position = first_position; position < nodes_ids.size(); position++) {
+		float arrival_time = end_of_service + problem.get_distance(nodes_ids[position - 1], nodes_ids[position]);
+		if (arrival_time > problem.get_customer_due_date(nodes_ids[position])) {
+			return false;
+		}
+		end_of_service = service_start_time(nodes_ids[position], arrival_time) + problem.get_customer_service_time(nodes_ids[position]);
+	}
+	return true;
+}
+
+void Local_search::find_best_move(unsigned int node_id, Move& best_move) const
+{
+	// Every move tried creates an arc between the node and one of its nearest neighbours
+	unsigned int route = node_routes[node_id];
+	unsigned int position = node_positions[node_id];
+
+	// Moving the node right after the fixed part of its route connects it to the depot (or to the last committed customer)
+	evaluate_relocate(route, position, position, route, first_movable_positions[route] - 1, false, best_move);
+
+	for (auto& neighbour_id : problem.get_local_search_neighbours(node_id)) {
+		unsigned int neighbour_route = node_routes[neighbour_id];
+		if (neighbour_route == no_route) {
+			continue;
+		}
+		unsigned int neighbour_position = node_positions[neighbour_id];
+
+		// Segments starting at the node go after the neighbour, or reversed before it ;
+		// segments ending at the node go reversed after the neighbour, or before it
+		for (unsigned int length = 1; length <= max_segment_length; length++) {
+			evaluate_relocate(route, position, position + length - 1, neighbour_route, neighbour_position, false, best_move);
+			evaluate_relocate(route, position, position + length - 1, neighbour_route, neighbour_position - 1, true, best_move);
+			if (length > 1 && position + 1 >= length) {
+				evaluate_relocate(route, position + 1 - length, position, neighbour_route, neighbour_position, true, best_move);
+				evaluate_relocate(route, position + 1 - length, position, neighbour_route, neighbour_position - 1, false, best_move);
+			}
+		}
+
+		if (neighbour_route == route) {
+			if (neighbour_position > position) {
+				evaluate_two_opt(route, position + 1, neighbour_position, best_move);
+				evaluate_two_opt(route, position, neighbour_position - 1, best_move);
+			}
 			else {
-				for (int node_k_idx = 1; node_k_idx < solution_vehicle[vehicle_i_idx].size() - 1; node_k_idx++) {
-					for (int node_l_idx = node_k_idx + 1; node_l_idx < solution_vehicle[vehicle_i_idx].size() - 1; node_l_idx++) {
-						if (!problem.has_c_node_been_committed(solution_vehicle[vehicle_i_idx][node_k_idx].node_id) && !problem.has_c_node_been_committed(solution_vehicle[vehicle_i_idx][node_l_idx].node_id)) {
-							if (intra_path_length_difference(node_k_idx, node_l_idx, vehicle_i_idx) < 0) {
-								intra_vehicle_swap(node_k_idx, node_l_idx, vehicle_i_idx);
-								if (ls_elapsed_since(time_0) > t_ls) {
-									return 0;
-								};
-							}
-						}
-					}
+				evaluate_two_opt(route, neighbour_position + 1, position, best_move);
+				evaluate_two_opt(route, neighbour_position, position - 1, best_move);
+			}
+		}
+		else {
+			// The route of the node goes on with the tail of the neighbour, or the other way around
+			evaluate_two_opt_star(route, position, neighbour_route, neighbour_position - 1, best_move);
+			evaluate_two_opt_star(route, position - 1, neighbour_route, neighbour_position, best_move);
+		}
+
+		// The route of the neighbour may have room right after its fixed part
+		evaluate_relocate(route, position, position, neighbour_route, first_movable_positions[neighbour_route] - 1, false, best_move);
+	}
+}
+
+void Local_search::apply_move(const Move& move)
+{
+	std::vector<unsigned int>& route_1 = routes[move.route_1];
+	std::vector<unsigned int>& route_2 = routes[move.route_2];
+
+	// The nodes at both ends of the removed arcs are looked at again once the move is applied
+	std::vector<unsigned int> touched_nodes_ids;
+	auto touch = [&](unsigned int route, unsigned int position) {
+		if (has_node(route, position)) {
+			touched_nodes_ids.push_back(node_at(route, position));
+		}
+	};
+
+	switch (move.type) {
+	case Move::Relocate:
+	{
+		touch(move.route_1, move.begin - 1);
+		touch(move.route_1, move.begin);
+		touch(move.route_1, move.end);
+		touch(move.route_1, move.end + 1);
+		touch(move.route_2, move.position);
+		touch(move.route_2, move.position + 1);
+
+		std::vector<unsigned int> segment(route_1.begin() + move.begin, route_1.begin() + move.end + 1);
+		if (move.reversed) {
+			std::reverse(segment.begin(), segment.end());
+		}
+
+		if (move.route_1 == move.route_2 && move.position > move.end) {
+			// We insert first so that the positions of the segment stay valid
+			route_2.insert(route_2.begin() + move.position + 1, segment.begin(), segment.end());
+			route_1.erase(route_1.begin() + move.begin, route_1.begin() + move.end + 1);
+		}
+		else {
+			route_1.erase(route_1.begin() + move.begin, route_1.begin() + move.end + 1);
+			route_2.insert(route_2.begin() + move.position + 1, segment.begin(), segment.end());
+		}
+		break;
+	}
+	case Move::TwoOpt:
+		touch(move.route_1, move.begin - 1);
+		touch(move.route_1, move.begin);
+		touch(move.route_1, move.end);
+		touch(move.route_1, move.end + 1);
+
+		std::reverse(route_1.begin() + move.begin, route_1.begin() + move.end + 1);
+		break;
+	case Move::TwoOptStar:
+	{
+		touch(move.route_1, move.begin);
+		touch(move.route_1, move.begin + 1);
+		touch(move.route_2, move.position);
+		touch(move.route_2, move.position + 1);
+
+		std::vector<unsigned int> tail_1(route_1.begin() + move.begin + 1, route_1.end());
+		route_1.erase(route_1.begin() + move.begin + 1, route_1.end());
+		route_1.insert(route_1.end(), route_2.begin() + move.position + 1, route_2.end());
+		route_2.erase(route_2.begin() + move.position + 1, route_2.end());
+		route_2.insert(route_2.end(), tail_1.begin(), tail_1.end());
+		break;
+	}
+	default:
+		return;
+	}
+
+	// Only the changed routes are walked
+	compute_route(move.route_1);
+	if (move.route_2 != move.route_1) {
+		compute_route(move.route_2);
+	}
+
+	for (auto& touched_node_id : touched_nodes_ids) {
+		activate(touched_node_id);
+	}
+}
+
+void Local_search::activate(unsigned int node_id)
+{
+	// Only the movable customers are looked at
+	if (dont_look_bits[node_id] && node_positions[node_id] >= first_movable_positions[node_routes[node_id]]) {
+		dont_look_bits[node_id] = false;
+		active_nodes_ids.push_back(node_id);
+	}
+}
+
+void Local_search::add_unused_vehicles_routes()
+{
+	for (unsigned int vehicle_number = 1; vehicle_number <= problem.get_num_vehicles(); vehicle_number++) {
+		unsigned int depot_id = problem.get_num_customers() + vehicle_number;
+		if (node_routes[depot_id] != no_route) {
+			continue;
+		}
+
+		std::vector<unsigned int> nodes_ids = { depot_id };
+		const std::vector<unsigned int>& commitments = problem.get_vehicle_commitments(vehicle_number);
+		nodes_ids.insert(nodes_ids.end(), commitments.begin(), commitments.end());
+
+		routes.push_back(nodes_ids);
+		prefix_loads.push_back({});
+		prefix_distances.push_back({});
+		service_starts.push_back({});
+		forward_slacks.push_back({});
+		first_movable_positions.push_back(nodes_ids.size());
+		compute_route(routes.size() - 1);
+	}
+}
+
+float Local_search::evaluate_insertion(unsigned int c_node_id, unsigned int route, unsigned int& position) const
+{
+	float best_cost = std::numeric_limits<float>::infinity();
+	if (prefix_loads[route].back() + problem.get_customer_demand(c_node_id) > (int)problem.get_vehicle_capacity()) {
+		return best_cost;
+	}
+
+	for (unsigned int p = first_movable_positions[route] - 1; p < routes[route].size(); p++) {
+		float cost = problem.get_distance(node_at(route, p), c_node_id);
+		if (has_node(route, p + 1)) {
+			cost += problem.get_distance(c_node_id, node_at(route, p + 1)) - arc_distance(route, p);
+		}
+
+		if (cost < best_cost && (!problem.has_time_windows() || insertion_fits_time_windows(route, p, &c_node_id, 1, false))) {
+			best_cost = cost;
+			position = p;
+		}
+	}
+
+	return best_cost;
+}
+
+void Local_search::insert_customer(unsigned int c_node_id, unsigned int route, unsigned int position)
+{
+	routes[route].insert(routes[route].begin() + position + 1, c_node_id);
+	compute_route(route);
+
+	// The new customer is looked at by the next search
+	activate(c_node_id);
+}
+
+std::vector<unsigned int> Local_search::insert_customers(const std::vector<unsigned int>& c_nodes_ids, ThreadPool* thread_pool)
+{
+	add_unused_vehicles_routes();
+
+	// Cost and position of the cheapest insertion of every pending customer in every route, one row per customer
+	std::vector<unsigned int> pending_c_nodes_ids = c_nodes_ids;
+	unsigned int num_routes = routes.size();
+	std::vector<float> costs(pending_c_nodes_ids.size() * num_routes);
+	std::vector<unsigned int> positions(pending_c_nodes_ids.size() * num_routes);
+
+	auto evaluate_routes = [&](unsigned int first_route, unsigned int last_route) {
+		auto evaluate_customer = [&](unsigned int i, unsigned int worker_index) {
+			for (unsigned int route = first_route; route < last_route; route++) {
+				costs[i * num_routes + route] = evaluate_insertion(pending_c_nodes_ids[i], route, positions[i * num_routes + route]);
+			}
+		};
+
+		if (thread_pool) {
+			thread_pool->run(pending_c_nodes_ids.size(), evaluate_customer);
+		}
+		else {
+			for (unsigned int i = 0; i < pending_c_nodes_ids.size(); i++) {
+				evaluate_customer(i, 0);
+			}
+		}
+	};
+
+	evaluate_routes(0, num_routes);
+
+	while (!pending_c_nodes_ids.empty()) {
+		const float infinity = std::numeric_limits<float>::infinity();
+		unsigned int chosen = pending_c_nodes_ids.size();
+		unsigned int chosen_route = 0;
+		float chosen_cost = infinity;
+		float chosen_regret = -infinity;
+
+		for (unsigned int i = 0; i < pending_c_nodes_ids.size(); i++) {
+			float best_cost = infinity;
+			float second_cost = infinity;
+			unsigned int best_route = 0;
+			for (unsigned int route = 0; route < num_routes; route++) {
+				float cost = costs[i * num_routes + route];
+				if (cost < best_cost) {
+					second_cost = best_cost;
+					best_cost = cost;
+					best_route = route;
+				}
+				else if (cost < second_cost) {
+					second_cost = cost;
 				}
 			}
+
+			// A customer only one route can take has an infinite regret, it goes first
+			float regret = second_cost - best_cost;
+			if (best_cost < infinity && (regret > chosen_regret || (regret == chosen_regret && best_cost < chosen_cost))) {
+				chosen = i;
+				chosen_route = best_route;
+				chosen_cost = best_cost;
+				chosen_regret = regret;
+			}
+		}
+
+		// No route can take any of the pending customers anymore
+		if (chosen == pending_c_nodes_ids.size()) {
+			break;
 		}
+
+		insert_customer(pending_c_nodes_ids[chosen], chosen_route, positions[chosen * num_routes + chosen_route]);
+
+		// The last row takes the place of the inserted customer's, then only the changed route is evaluated again
+		unsigned int last = pending_c_nodes_ids.size() - 1;
+		pending_c_nodes_ids[chosen] = pending_c_nodes_ids[last];
+		std::copy(costs.begin() + last * num_routes, costs.begin() + (last + 1) * num_routes, costs.begin() + chosen * num_routes);
+		std::copy(positions.begin() + last * num_routes, positions.begin() + (last + 1) * num_routes, positions.begin() + chosen * num_routes);
+		pending_c_nodes_ids.pop_back();
+		costs.resize(pending_c_nodes_ids.size() * num_routes);
+		positions.resize(pending_c_nodes_ids.size() * num_routes);
+
+		evaluate_routes(chosen_route, chosen_route + 1);
 	}
+
+	return pending_c_nodes_ids;
 }
 
-std::vector<TourAtom> Local_search::solution_from_search()
+unsigned int Local_search::search(unsigned int max_moves)
 {
-	unsigned int solution_length = solution_vehicle.size();
-	unsigned int last_vehicle_length = solution_vehicle[solution_length - 1].size();
+	unsigned int num_moves = 0;
 
-	std::vector<TourAtom> final_solution;
-	for (int i = 0; i < solution_vehicle.size(); i++) {
-		for (int j = 0; j < solution_vehicle[i].size() - 1; j++) {
-			final_solution.push_back(solution_vehicle[i][j]);
+	while (!active_nodes_ids.empty() && num_moves < max_moves) {
+		unsigned int node_id = active_nodes_ids.back();
+		active_nodes_ids.pop_back();
+		dont_look_bits[node_id] = true;
+
+		Move best_move;
+		best_move.gain = min_gain;
+		find_best_move(node_id, best_move);
+
+		if (best_move.type != Move::None) {
+			apply_move(best_move);
+			activate(node_id);
+			num_moves++;
 		}
 	}
-	final_solution.push_back(solution_vehicle[solution_length - 1][last_vehicle_length - 1]);
-	return final_solution;
+
+	return num_moves;
 }
 
-void Local_search::update_tour_atom_values(unsigned int from_node_position, unsigned int vehicle_position)
+float Local_search::get_score() const
 {
-	int current_load = problem.get_customer_demand(solution_vehicle[vehicle_position][from_node_position - 1].node_id);
-	float current_service_time = problem.get_customer_service_time(solution_vehicle[vehicle_position][from_node_position - 1].node_id);
-	float current_distance = solution_vehicle[vehicle_position][from_node_position - 1].distance;
+	float score = 0;
+	for (auto& route_prefix_distances : prefix_distances) {
+		score += route_prefix_distances.back();
+	}
+	return score;
+}
 
-	for (int i = from_node_position; i < solution_vehicle[vehicle_position].size()-1; i++) {
-		current_load += problem.get_customer_demand(solution_vehicle[vehicle_position][i].node_id);
-		current_service_time += problem.get_distance(solution_vehicle[vehicle_position][i].node_id, solution_vehicle[vehicle_position][i-1].node_id);
-		current_service_time += problem.get_customer_service_time(solution_vehicle[vehicle_position][i].node_id);
-		current_distance += problem.get_distance(solution_vehicle[vehicle_position][i].node_id, solution_vehicle[vehicle_position][i - 1].node_id);
-		solution_vehicle[vehicle_position][i].load = current_load;
-		solution_vehicle[vehicle_position][i].end_of_service = current_service_time;
-		solution_vehicle[vehicle_position][i].distance = current_distance;
+std::vector<TourAtom> Local_search::solution_from_search() const
+{
+	// The atoms are rebuilt the way the ants build them
+	std::vector<TourAtom> final_solution;
+	for (unsigned int route = 0; route < routes.size(); route++) {
+		const std::vector<unsigned int>& nodes_ids = routes[route];
+		// The routes of the unused vehicles are left out like the ants leave them out, unless no route serves anyone
+		if (nodes_ids.size() == 1 && !(final_solution.empty() && route + 1 == routes.size())) {
+			continue;
+		}
+
+		int load = 0;
+		float end_of_service = 0;
+		float distance = 0;
+
+		final_solution.push_back(TourAtom(nodes_ids[0], 0, 0, 0));
+		for (unsigned int position = 1; position < nodes_ids.size(); position++) {
+			float arc = problem.get_distance(nodes_ids[position - 1], nodes_ids[position]);
+			load += problem.get_customer_demand(nodes_ids[position]);
+			if (position < first_movable_positions[route]) {
+				end_of_service = problem.get_commitment_end_of_service(nodes_ids[position]);
+			}
+			else {
+				if (position == first_movable_positions[route]) {
+					end_of_service = problem.get_departure_time(end_of_service);
+				}
+				end_of_service = service_start_time(nodes_ids[position], end_of_service + arc) + problem.get_customer_service_time(nodes_ids[position]);
+			}
+			distance += arc;
+			final_solution.push_back(TourAtom(nodes_ids[position], load, end_of_service, distance));
+		}
 	}
+	return final_solution;
 }
 
 float Local_search::compute_solution_score(const std::vector<TourAtom>& solution) const
@@ -206,10 +687,8 @@ float Local_search::compute_solution_score(const std::vector<TourAtom>& solution
 	float score = 0;
 	float last_distance = 0;
 
-	for (const auto& tour_atom : solution)
-	{
-		if (problem.is_node_depot(tour_atom.node_id))
-		{
+	for (const auto& tour_atom : solution) {
+		if (problem.is_node_depot(tour_atom.node_id)) {
 			score += last_distance;
 		}
 		last_distance = tour_atom.distance;
@@ -218,4 +697,4 @@ float Local_search::compute_solution_score(const std::vector<TourAtom>& solution
 	score += last_distance;
 
 	return score;
-}
\ No newline at end of file
+}
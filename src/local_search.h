@@ -1,29 +1,101 @@
+#pragma once
+
 #include <vector>
 #include "problem.h"
 #include "tour_atom.h"
-#include <iostream>
-#include <time.h>
-#include <string>
-#include <chrono>
-
+#include "thread_pool.h"
 
-class Local_search	
+// Improves a solution with relocate / or-opt, 2-opt and 2-opt* moves.
+// Every route keeps its cumulated loads and distances, so the gain and the feasibility of a move are known in O(1) ;
+// only the applied moves walk the routes they change.
+// The moves are only tried around the nearest neighbours of a node (Problem::get_local_search_neighbours), and a node whose moves have all failed
+// is not looked at again (don't look bit) until one of its arcs changes.
+// The routes are open (the return to the depot is not counted) and the committed customers at the begining
+// of a route never move. When the problem has time windows, a move is only applied if every customer is still
+// served within its window ; the committed customers keep the times they were committed with and the rest
+// of a route can't start before the time of the problem.
+class Local_search
 {
 private:
-	Problem problem;
-	std::vector<TourAtom> solution;
-	std::vector<std::vector<TourAtom>> solution_vehicle;
-
-	int calculate_remaining_demand(unsigned int to_touratom_position, unsigned int vehicle_position);
-	int calculate_capacity_left_before(unsigned int to_touratom_position, unsigned int vehicle_position);
-	float inter_vehicle_path_length_difference( unsigned int to_touratom_position_in_vehicle1, unsigned int vehicle1_position, unsigned int to_touratom_position_in_vehicle2, unsigned int vehicle2_position);
-	float intra_path_length_difference(unsigned int touratom_position1, unsigned int touratom_position2, unsigned int vehicle_position);
-	void update_tour_atom_values(unsigned int to_touratom_position, unsigned int vehicle_position);
-	void inter_vehicle_swap(unsigned int to_touratom_position_in_vehicle1, unsigned int vehicle1_position, unsigned int to_touratom_position_in_vehicle2, unsigned int vehicle2_position);
-	void intra_vehicle_swap(unsigned int touratom_position1, unsigned int touratom_position2, unsigned int vehicle_position);
+	// One move applied by apply_move, positions are the ones before the move
+	struct Move
+	{
+		enum Type { None, Relocate, TwoOpt, TwoOptStar } type = None;
+		float gain = 0;
+		unsigned int route_1 = 0;
+		unsigned int route_2 = 0;
+		// Relocate : segment [begin, end] of route_1 inserted after position of route_2
+		// TwoOpt : segment [begin, end] of route_1 reversed
+		// TwoOptStar : the tails after begin in route_1 and after position in route_2 are exchanged
+		unsigned int begin = 0;
+		unsigned int end = 0;
+		unsigned int position = 0;
+		bool reversed = false;
+	};
+
+	const Problem &problem;
+
+	// Node ids of every route, starting with its depot
+	std::vector<std::vector<unsigned int>> routes;
+	// Load and distance of a route up to and including each of its positions
+	std::vector<std::vector<int>> prefix_loads;
+	std::vector<std::vector<float>> prefix_distances;
+	// With time windows : start of service at each position, and forward time slack, the largest delay of that start
+	// which keeps the rest of the route within its windows
+	std::vector<std::vector<float>> service_starts;
+	std::vector<std::vector<float>> forward_slacks;
+	// Position of the first node of a route that may move (after the depot and the committed customers)
+	std::vector<unsigned int> first_movable_positions;
+
+	// Route and position of every node of the solution, indexed by node id
+	std::vector<unsigned int> node_routes;
+	std::vector<unsigned int> node_positions;
+
+	std::vector<bool> dont_look_bits;
+	std::vector<unsigned int> active_nodes_ids;
+
+	void compute_route(unsigned int route);
+
+	float arc_distance(unsigned int route, unsigned int position) const;
+	bool has_node(unsigned int route, unsigned int position) const;
+	unsigned int node_at(unsigned int route, unsigned int position) const;
+
+	void evaluate_relocate(unsigned int route_1, unsigned int begin, unsigned int end, unsigned int route_2, unsigned int position, bool reversed, Move &best_move) const;
+	void evaluate_two_opt(unsigned int route, unsigned int begin, unsigned int end, Move &best_move) const;
+	void evaluate_two_opt_star(unsigned int route_1, unsigned int position_1, unsigned int route_2, unsigned int position_2, Move &best_move) const;
+	void consider_move(const Move &move, Move &best_move) const;
+	void find_best_move(unsigned int node_id, Move &best_move) const;
+
+	// Time windows feasibility of a move, in O(1) with the forward time slacks except for the moves inside a route
+	bool move_fits_time_windows(const Move &move) const;
+	bool insertion_fits_time_windows(unsigned int route, unsigned int position, const unsigned int *nodes_ids, unsigned int num_nodes, bool reversed) const;
+	bool tail_fits_time_windows(unsigned int route_1, unsigned int position_1, unsigned int route_2, unsigned int position_2) const;
+	// nodes_ids is the route after a move which kept its fixed part
+	bool route_fits_time_windows(unsigned int route, const std::vector<unsigned int> &nodes_ids) const;
+	float service_start_time(unsigned int node_id, float arrival_time) const;
+	// Time the vehicle leaves the node at position, not before the time of the problem after the fixed part of the route
+	float departure_time(unsigned int route, unsigned int position) const;
+	void apply_move(const Move &move);
+	void activate(unsigned int node_id);
+
+	void add_unused_vehicles_routes();
+	// Cost of the cheapest feasible position of a customer in a route, infinite if the route can't take it
+	float evaluate_insertion(unsigned int c_node_id, unsigned int route, unsigned int &position) const;
+	void insert_customer(unsigned int c_node_id, unsigned int route, unsigned int position);
+
 public:
-	Local_search(const Problem& p_problem, std::vector<TourAtom>& p_solution);
-	int search(int t_ls);
-	float compute_solution_score(const std::vector<TourAtom>& solution) const;
-	std::vector<TourAtom> solution_from_search();
-};
\ No newline at end of file
+	static const unsigned int max_segment_length = 3;
+
+	Local_search(const Problem &problem, const std::vector<TourAtom> &solution);
+
+	// Inserts customers missing from the solution by regret insertion : the customer whose cheapest route beats
+	// its second cheapest by the most is inserted first, at its cheapest position. The vehicles the solution
+	// does not use get a route. The insertion costs are evaluated on the thread pool when there is one.
+	// Returns the customers no route could take
+	std::vector<unsigned int> insert_customers(const std::vector<unsigned int> &c_nodes_ids, ThreadPool *thread_pool = nullptr);
+	// Applies improving moves until none is left (or max_moves have been applied), returns the number of moves applied
+	unsigned int search(unsigned int max_moves = 100000);
+	float compute_solution_score(const std::vector<TourAtom> &solution) const;
+	float get_score() const;
+	std::vector<TourAtom> solution_from_search() const;
+};
@@ -0,0 +1,84 @@
+#include "local_search_worker.h"
+#include "local_search.h"
+
+LocalSearchWorker::LocalSearchWorker(const Problem &problem) : problem{problem}, pending_solution{nullptr}, result{nullptr}, busy{false}, stopping{false}
+{
+    thread = std::thread(&LocalSearchWorker::worker_loop, this);
+}
+
+LocalSearchWorker::~LocalSearchWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+
+    delete pending_solution.exchange(nullptr);
+    delete result.exchange(nullptr);
+}
+
+void LocalSearchWorker::submit(const std::vector<TourAtom> &solution)
+{
+    delete pending_solution.exchange(new std::vector<TourAtom>(solution));
+
+    // Taking the mutex before notifying makes sure that the worker is either waiting or will see the job
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    condition.notify_one();
+}
+
+std::unique_ptr<LocalSearchWorker::Result> LocalSearchWorker::take_result()
+{
+    return std::unique_ptr<Result>(result.exchange(nullptr));
+}
+
+void LocalSearchWorker::synchronize()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this]() { return !busy && pending_solution.load() == nullptr; });
+}
+
+void LocalSearchWorker::worker_loop()
+{
+    while (true)
+    {
+        std::unique_ptr<std::vector<TourAtom>> solution;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || pending_solution.load() != nullptr; });
+            if (stopping)
+            {
+                return;
+            }
+
+            // The job is taken under the mutex so that synchronize sees it either pending or in progress
+            solution.reset(pending_solution.exchange(nullptr));
+            busy = solution != nullptr;
+        }
+
+        if (solution)
+        {
+            Local_search local_search(problem, *solution);
+            unsigned int num_moves = local_search.search();
+
+            if (num_moves > 0)
+            {
+                Result *improved = new Result();
+                improved->solution = local_search.solution_from_search();
+                improved->score = local_search.compute_solution_score(improved->solution);
+                improved->num_moves = num_moves;
+
+                delete result.exchange(improved);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy = false;
+        }
+        condition.notify_all();
+    }
+}
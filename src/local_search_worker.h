@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include "problem.h"
+#include "tour_atom.h"
+
+// Background thread improving the solutions published by the colony with Local_search.
+// The solutions go through single slots swapped with atomic exchanges : a newer submission replaces a job
+// the worker has not started yet, and a newer result replaces one the colony has not taken yet, so the colony
+// never waits for the worker. The mutex only puts the worker to sleep when it has nothing to do.
+// The worker reads the problem, so it must be synchronized before the problem changes.
+class LocalSearchWorker
+{
+public:
+    struct Result
+    {
+        std::vector<TourAtom> solution;
+        float score;
+        unsigned int num_moves;
+    };
+
+private:
+    const Problem &problem;
+
+    std::atomic<std::vector<TourAtom> *> pending_solution;
+    std::atomic<Result *> result;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool busy;
+    bool stopping;
+    std::thread thread;
+
+    void worker_loop();
+
+public:
+    LocalSearchWorker(const Problem &problem);
+    ~LocalSearchWorker();
+
+    LocalSearchWorker(const LocalSearchWorker &) = delete;
+    LocalSearchWorker &operator=(const LocalSearchWorker &) = delete;
+
+    void submit(const std::vector<TourAtom> &solution);
+    // Returns the last improved solution if there is one the colony has not taken yet, never blocks
+    std::unique_ptr<Result> take_result();
+    // Waits until the worker has improved the last submitted solution, its result can then be taken
+    void synchronize();
+};
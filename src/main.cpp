@@ -4,152 +4,394 @@
 #include <chrono>
 #include <time.h>
 #include <fstream>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <memory>
+#include <stdexcept>
+#include <sstream>
+#include <limits>
 
 #include "local_search.h"
 
 #include "problem.h"
 #include "ant_colony.h"
+#include "selection_kernel.h"
+#include "working_day.h"
+#include "island_model.h"
+#include "order_stream.h"
+#include "trace_writer.h"
 
 unsigned int T_wd = 100;
 unsigned int n_ts = 50;
 double t_ts = (double)T_wd / (double)n_ts;
 
-bool timeslice_over(const std::chrono::high_resolution_clock::time_point &time_0, unsigned int timeslice, double t_ts)
+unsigned int count_steps_during(AntColony &ant_colony, double duration)
 {
-    // We compute the time elapsed since the begining of the working day to find if we are still in the timeslice
-    auto now = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = now - time_0;
+    // Step the colony for duration seconds and return the number of steps performed
+    auto time_0 = std::chrono::high_resolution_clock::now();
+    unsigned int steps_counter = 0;
+
+    while (elapsed_since(time_0) < duration)
+    {
+        ant_colony.step();
+        steps_counter++;
+    }
 
-    return elapsed.count() >= timeslice * t_ts;
+    return steps_counter;
 }
 
-double elapsed_since(const std::chrono::high_resolution_clock::time_point &time)
+bool parse_values(const std::string &text, std::vector<float> &values)
 {
-    auto now = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = now - time;
-
-    return elapsed.count();
+    // Comma separated values, e.g. 0.8,0.9,0.95
+    values.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ','))
+    {
+        std::istringstream item_iss(item);
+        float value;
+        if (!(item_iss >> value))
+        {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
 }
 
-int main()
+int main(int argc, char *argv[])
 {
 
-    srand(time(NULL));
-
     std::string filepath = "../benchmarks/vanveen/rc101-0.7.txt";
-    Problem problem = Problem(filepath, T_wd, n_ts);
-    auto diff = problem.update(0);
+    unsigned int num_threads = 1;
+    ProblemOptions problem_options;
+    AntColonyOptions ant_colony_options;
+    ant_colony_options.seed = std::random_device()();
+    bool measure_speedup = false;
+    std::string cache_filepath;
+    WorkingDayOptions working_day_options;
+    std::string metrics_filepath;
+    MetricsFormat metrics_format = MetricsFormat::JsonLines;
+    unsigned int num_islands = 1;
+    IslandModelOptions island_model_options;
+    // Island i gets the value i modulo the size of each list
+    std::vector<float> islands_alpha = {1};
+    std::vector<float> islands_beta = {1};
+    std::vector<float> islands_q_0 = {0.9};
+    std::vector<float> islands_rho = {0.1};
+    std::string stream_source;
+    std::string commitments_filepath;
+    TraceLevel trace_level = TraceLevel::Timeslices;
+    std::string trace_directory = "data";
+
+    for (auto i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
 
-    // For plotting
-    // problem.visual_dump_data();
-    problem.dump_to_file("../data/problem_data.txt");
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            num_threads = std::stoul(argv[++i]);
+        }
+        else if (arg == "--instance" && i + 1 < argc)
+        {
+            filepath = argv[++i];
+        }
+        else if (arg == "--candidates" && i + 1 < argc)
+        {
+            problem_options.num_neighbours = std::stoul(argv[++i]);
+        }
+        else if (arg == "--distance-backend" && i + 1 < argc)
+        {
+            if (!DistanceOracle::parse_backend(argv[++i], problem_options.distance_backend))
+            {
+                std::cerr << "Unknown distance backend " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--distance-memory" && i + 1 < argc)
+        {
+            // In megabytes
+            problem_options.distance_memory_budget = std::stoull(argv[++i]) << 20;
+        }
+        else if (arg == "--sparse-pheromons")
+        {
+            ant_colony_options.sparse_pheromons = true;
+        }
+        else if (arg == "--time-windows")
+        {
+            problem_options.time_windows = true;
+        }
+        else if (arg == "--local-search")
+        {
+            ant_colony_options.local_search = true;
+        }
+        else if (arg == "--local-search-worker")
+        {
+            ant_colony_options.local_search_worker = true;
+        }
+        else if (arg == "--kernel" && i + 1 < argc)
+        {
+            std::string kernel_name = argv[++i];
+            if (!set_selection_kernel(kernel_name))
+            {
+                std::cerr << "The " << kernel_name << " selection kernel is not supported on this CPU." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            ant_colony_options.seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--speedup")
+        {
+            measure_speedup = true;
+        }
+        else if (arg == "--steps-per-timeslice" && i + 1 < argc)
+        {
+            working_day_options.budget = TimesliceBudget::Steps;
+            working_day_options.steps_per_timeslice = std::stoul(argv[++i]);
+            if (working_day_options.steps_per_timeslice == 0)
+            {
+                std::cerr << "A timeslice needs at least one step." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--cpu-time-per-timeslice" && i + 1 < argc)
+        {
+            working_day_options.budget = TimesliceBudget::CpuTime;
+            working_day_options.cpu_time_per_timeslice = std::stod(argv[++i]);
+        }
+        else if (arg == "--metrics" && i + 1 < argc)
+        {
+            metrics_filepath = argv[++i];
+        }
+        else if (arg == "--metrics-format" && i + 1 < argc)
+        {
+            if (!MetricsSink::parse_format(argv[++i], metrics_format))
+            {
+                std::cerr << "Unknown metrics format " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--islands" && i + 1 < argc)
+        {
+            num_islands = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (arg == "--migration-interval" && i + 1 < argc)
+        {
+            island_model_options.migration_interval = std::stoul(argv[++i]);
+        }
+        else if ((arg == "--island-alpha" || arg == "--island-beta" || arg == "--island-q0" || arg == "--island-rho") && i + 1 < argc)
+        {
+            std::vector<float> &values = arg == "--island-alpha" ? islands_alpha : arg == "--island-beta" ? islands_beta : arg == "--island-q0" ? islands_q_0 : islands_rho;
+            if (!parse_values(argv[++i], values))
+            {
+                std::cerr << "Invalid list of values " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--stream" && i + 1 < argc)
+        {
+            stream_source = argv[++i];
+        }
+        else if (arg == "--stream-capacity" && i + 1 < argc)
+        {
+            problem_options.stream_capacity = std::stoul(argv[++i]);
+        }
+        else if (arg == "--commitments" && i + 1 < argc)
+        {
+            commitments_filepath = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            if (!TraceWriter::parse_level(argv[++i], trace_level))
+            {
+                std::cerr << "Unknown trace level " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--trace-directory" && i + 1 < argc)
+        {
+            trace_directory = argv[++i];
+        }
+        else if (arg == "--write-cache" && i + 1 < argc)
+        {
+            cache_filepath = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--instance path] [--threads N] [--candidates k] [--distance-backend dense|triangular|half|on-the-fly|auto] [--distance-memory MB] [--sparse-pheromons] [--time-windows] [--local-search] [--local-search-worker] [--kernel scalar|avx2|avx512] [--seed S] [--speedup] [--steps-per-timeslice N | --cpu-time-per-timeslice seconds] [--metrics path] [--metrics-format jsonl|csv] [--islands N] [--migration-interval steps] [--island-alpha list] [--island-beta list] [--island-q0 list] [--island-rho list] [--stream -|path|unix:path] [--stream-capacity N] [--commitments path] [--trace off|timeslices|solutions] [--trace-directory path] [--write-cache path]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (ant_colony_options.sparse_pheromons && problem_options.num_neighbours == 0)
+    {
+        std::cerr << "Sparse pheromons need candidate lists (--candidates k)." << std::endl;
+        return 1;
+    }
+
+    // The neighbour lists of the local search are only kept when it runs
+    if (!ant_colony_options.local_search && !ant_colony_options.local_search_worker)
+    {
+        problem_options.num_local_search_neighbours = 0;
+    }
 
-    AntColony ant_colony = AntColony(&problem, 10, 1, 1, 0.9, 0.1);
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    unsigned int counter = 0;
+    // A day bounded by steps must not depend on the speed of the host, the rebuilds are only bounded by attempts
+    if (working_day_options.budget == TimesliceBudget::Steps)
+    {
+        ant_colony_options.rebuild_time_limit = std::numeric_limits<double>::infinity();
+    }
 
-    auto time_0 = std::chrono::high_resolution_clock::now();
-    unsigned int timeslice = 1;
+    // The orders need free slots to land in
+    if (!stream_source.empty() && problem_options.stream_capacity == 0)
+    {
+        problem_options.stream_capacity = 1000;
+    }
 
-    while (elapsed_since(time_0) < 75)
+    // 0 means one thread per core
+    if (num_threads == 0)
     {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The seed is printed so that any run can be reproduced
+    std::cout << "Seed : " << ant_colony_options.seed << std::endl;
 
-        std::cout << "Starting timeslice " << timeslice << "." << std::endl;
+    problem_options.num_threads = num_threads;
+    ant_colony_options.num_threads = num_threads;
+    std::unique_ptr<Problem> loaded_problem;
+    auto load_time_0 = std::chrono::high_resolution_clock::now();
+    try
+    {
+        loaded_problem = std::unique_ptr<Problem>(new Problem(filepath, T_wd, n_ts, problem_options));
+    }
+    catch (const std::runtime_error &error)
+    {
+        std::cerr << error.what() << "." << std::endl;
+        return 1;
+    }
+    Problem &problem = *loaded_problem;
+    std::cout << "Instance loaded in " << elapsed_since(load_time_0) << " s." << std::endl;
 
-        unsigned int ant_colony_steps_counter = 0;
-        while (!timeslice_over(time_0, timeslice, t_ts))
+    // We only compile the instance, the cache is then given to --instance
+    if (!cache_filepath.empty())
+    {
+        if (!problem.write_cache(cache_filepath))
         {
-            ant_colony.step();
-            ant_colony_steps_counter++;
+            std::cerr << "Can't write the instance cache " << cache_filepath << "." << std::endl;
+            return 1;
         }
+        std::cout << "Instance cache written to " << cache_filepath << "." << std::endl;
+        return 0;
+    }
 
-        std::cout << "Ant Colony stepped " << ant_colony_steps_counter << " times." << std::endl;
+    std::cout << "Distances use the " << DistanceOracle::backend_name(problem.get_distance_oracle().get_backend()) << " backend ("
+              << (problem.get_distance_oracle().get_memory_usage() >> 20) << " MB)." << std::endl;
+    problem.update(0);
 
-        auto best_solution = ant_colony.get_best_solution();
-        auto best_solution_score = ant_colony.get_best_solution_score();
+    // For plotting
+    // problem.visual_dump_data();
+    problem.dump_to_file("../data/problem_data.txt");
 
-        std::cout << "The current best solution score is " << best_solution_score << "." << std::endl;
+    if (measure_speedup && num_threads > 1)
+    {
+        // We measure the steps per timeslice of the serial and of the parallel colony on the initial problem
+        // with throwaway colonies so that the working day below is not affected
+        AntColonyOptions serial_options = ant_colony_options;
+        serial_options.num_threads = 1;
 
-        // for (auto &tour_atom : best_solution)
-        // {
-        //     std::cout << "( " << tour_atom.node_id << ", " << tour_atom.load << ", " << tour_atom.end_of_service << ", " << tour_atom.distance << " )" << std::endl;
-        // }
+        AntColony serial_colony(&problem, 10, 1, 1, 0.9, 0.1, serial_options);
+        AntColony parallel_colony(&problem, 10, 1, 1, 0.9, 0.1, ant_colony_options);
 
-        // Here we compute which nodes from the current solution are to be committed
-        // A node from the best solution is committed if the servicing time of the vehicle serving it falls within the next t_ts seconds
-        unsigned int current_vehicle_number = best_solution[0].node_id - problem.get_num_customers();
-        for (auto i = 1; i < best_solution.size(); i++)
-        {
-            unsigned int node_id = best_solution[i].node_id;
+        unsigned int serial_steps = count_steps_during(serial_colony, t_ts);
+        unsigned int parallel_steps = count_steps_during(parallel_colony, t_ts);
 
-            if (problem.is_node_depot(node_id))
-            {
-                current_vehicle_number = node_id - problem.get_num_customers();
-            }
-            else
-            {
-                // We check the servicing time of the last commitment ;
-                // it needs to fall in the next step for the node to be committed
-                if (best_solution[i - 1].end_of_service < (timeslice + 1) * t_ts)
-                {
-                    // We check if the node has not already been committed
-                    if (!problem.has_c_node_been_committed(node_id))
-                    {
-                        problem.commit(node_id, current_vehicle_number);
-                        std::cout << "Commitment of node " << node_id << " to vehicle " << current_vehicle_number << std::endl;
-                    }
-                }
-            }
-        }
+        std::cout << "Serial colony stepped " << serial_steps << " times per timeslice." << std::endl;
+        std::cout << "Parallel colony (" << num_threads << " threads) stepped " << parallel_steps << " times per timeslice." << std::endl;
+        std::cout << "Speedup : " << (double)parallel_steps / (double)std::max(1u, serial_steps) << std::endl;
+    }
 
-        // <DEBUG>
-        // Dump the data for this timeslice
-        std::ofstream timeslice_data_file;
-        std::string filename = "data/timeslice_" + std::to_string(timeslice) + ".txt";
-        timeslice_data_file.open(filename);
-        auto available_c_nodes_ids = problem.get_available_c_nodes_ids();
-        for (auto &available_c_node_id : available_c_nodes_ids)
-        {
-            timeslice_data_file << available_c_node_id << ", ";
-        }
-        timeslice_data_file << std::endl;
-        auto committed_c_nodes_ids = problem.get_committed_c_nodes_ids();
-        for (auto &committed_c_node_id : committed_c_nodes_ids)
+    working_day_options.t_ts = t_ts;
+
+    // The progress of the day is printed with the traces, --trace off leaves the solver thread alone
+    working_day_options.verbose = trace_level != TraceLevel::Off;
+
+    // The traces are written on their own thread, the colony only copies them
+    std::unique_ptr<TraceWriter> trace_writer;
+    if (trace_level != TraceLevel::Off)
+    {
+        trace_writer = std::unique_ptr<TraceWriter>(new TraceWriter(trace_directory, trace_level));
+        working_day_options.trace = trace_writer.get();
+        ant_colony_options.trace = trace_writer.get();
+    }
+
+    std::unique_ptr<MetricsSink> metrics_sink;
+    if (!metrics_filepath.empty())
+    {
+        metrics_sink = std::unique_ptr<MetricsSink>(new MetricsSink(metrics_filepath, metrics_format));
+        if (!metrics_sink->is_open())
         {
-            timeslice_data_file << committed_c_node_id << ", ";
+            std::cerr << "Can't write the metrics to " << metrics_filepath << "." << std::endl;
+            return 1;
         }
-        timeslice_data_file << std::endl;
-        for (auto &tour_atom : best_solution)
+        working_day_options.metrics_sink = metrics_sink.get();
+    }
+
+    std::unique_ptr<OrderStream> order_stream;
+    if (!stream_source.empty())
+    {
+        order_stream = std::unique_ptr<OrderStream>(new OrderStream(stream_source, commitments_filepath));
+        if (!order_stream->is_open())
         {
-            timeslice_data_file << tour_atom.node_id << ", " << tour_atom.load << ", " << tour_atom.end_of_service << ", " << tour_atom.distance << std::endl;
+            std::cerr << "Can't stream the orders from " << stream_source << "." << std::endl;
+            return 1;
         }
-        timeslice_data_file.close();
-        // </ DEBUG>
-
-        //std::cout << "Before insertion of new nodes " << ant_colony.get_best_solution_score() << std::endl;
+        working_day_options.order_stream = order_stream.get();
+    }
 
-        // We update the problem for the new timeslice
-        diff = problem.update((timeslice + 1) * t_ts);
-        std::cout << "There are " << diff.size() << " new customers available." << std::endl;
+    WorkingDayResult result;
+    unsigned int num_colony_threads;
 
-        if (diff.size() != 0)
+    if (num_islands > 1)
+    {
+        // Every island runs on its own thread, the islands take the place of the threads of a single colony
+        std::vector<IslandParameters> islands_parameters(num_islands);
+        for (auto island = 0; island < num_islands; island++)
         {
-            // std::cout << diff.size() << " new nodes" << std::endl;
-            ant_colony.update_solution();
+            islands_parameters[island].alpha = islands_alpha[island % islands_alpha.size()];
+            islands_parameters[island].beta = islands_beta[island % islands_beta.size()];
+            islands_parameters[island].q_0 = islands_q_0[island % islands_q_0.size()];
+            islands_parameters[island].rho = islands_rho[island % islands_rho.size()];
         }
+        island_model_options.ant_colony_options = ant_colony_options;
 
-        //std::cout << "After insertion of new nodes : " << ant_colony.get_best_solution_score() << std::endl;
+        IslandModel island_model(&problem, islands_parameters, island_model_options);
+        std::cout << num_islands << " islands, migrating every " << island_model_options.migration_interval << " steps." << std::endl;
 
-        std::cout << "Ending timeslice " << timeslice << "." << std::endl;
+        result = run_working_day(problem, island_model, working_day_options);
+        num_colony_threads = num_islands;
+    }
+    else
+    {
+        AntColony ant_colony(&problem, 10, islands_alpha[0], islands_beta[0], islands_q_0[0], islands_rho[0], ant_colony_options);
 
-        timeslice++;
+        std::cout << "Pheromons use the " << (ant_colony.get_pheromon_store().is_sparse() ? "sparse" : "dense") << " layout ("
+                  << (ant_colony.get_pheromon_store().get_memory_usage() >> 20) << " MB)." << std::endl;
 
-        // For plotting
-        // ant_colony.visual_dump_data();
+        result = run_working_day(problem, ant_colony, working_day_options);
+        num_colony_threads = ant_colony.get_num_threads();
     }
 
-    std::cout << "Score of working day's solution : " << ant_colony.get_best_solution_score() << std::endl;
+    std::cout << "Ant Colony stepped " << result.steps_per_timeslice << " times per timeslice on average with " << num_colony_threads << " thread(s), the " << get_selection_kernel().name << " selection kernel and "
+              << (problem_options.num_neighbours > 0 ? std::to_string(problem_options.num_neighbours) + " nearest neighbours" : std::string("full")) << " candidate lists." << std::endl;
+
+    std::cout << "Score of working day's solution : " << result.score << std::endl;
+    std::cout << "Scaled back : " << result.scaled_back_score << std::endl;
 
-    // We can scale it back like that because of norms properties ( || \alpha x|| = |\alpha| ||x||)
-    std::cout << "Scaled back : " << ant_colony.get_best_solution_score() / problem.get_scaling_factor() << std::endl;
+    if (trace_writer && trace_writer->get_num_dropped() > 0)
+    {
+        std::cout << trace_writer->get_num_dropped() << " traces were dropped, the trace writer could not keep up." << std::endl;
+    }
 }
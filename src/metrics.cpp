@@ -0,0 +1,66 @@
+#include "metrics.h"
+
+MetricsSink::MetricsSink(const std::string &filename, MetricsFormat format) : file{filename}, format{format}
+{
+    if (format == MetricsFormat::Csv)
+    {
+        file << "timeslice,steps,ants_built,ants_stuck,average_candidates,new_customers,inserted_customers,rebuild_attempts,rejected_customers,local_search_moves,"
+             << "construction_time,pheromon_update_time,local_search_time,update_solution_time,commit_time,"
+             << "best_score_before_arrivals,best_score_after_arrivals" << std::endl;
+    }
+}
+
+bool MetricsSink::is_open() const
+{
+    return file.is_open();
+}
+
+void MetricsSink::write(const TimesliceMetrics &metrics)
+{
+    // One line per timeslice, flushed so that a running day can be followed
+    if (format == MetricsFormat::Csv)
+    {
+        file << metrics.timeslice << "," << metrics.num_steps << "," << metrics.num_ants_built << "," << metrics.num_ants_stuck << ","
+             << metrics.average_candidates << "," << metrics.num_new_customers << "," << metrics.num_inserted_customers << "," << metrics.num_rebuild_attempts << "," << metrics.num_rejected_customers << "," << metrics.num_local_search_moves << ","
+             << metrics.construction_time << "," << metrics.pheromon_update_time << "," << metrics.local_search_time << "," << metrics.update_solution_time << "," << metrics.commit_time << ","
+             << metrics.best_score_before_arrivals << "," << metrics.best_score_after_arrivals << std::endl;
+    }
+    else
+    {
+        file << "{\"timeslice\": " << metrics.timeslice
+             << ", \"steps\": " << metrics.num_steps
+             << ", \"ants_built\": " << metrics.num_ants_built
+             << ", \"ants_stuck\": " << metrics.num_ants_stuck
+             << ", \"average_candidates\": " << metrics.average_candidates
+             << ", \"new_customers\": " << metrics.num_new_customers
+             << ", \"inserted_customers\": " << metrics.num_inserted_customers
+             << ", \"rebuild_attempts\": " << metrics.num_rebuild_attempts
+             << ", \"rejected_customers\": " << metrics.num_rejected_customers
+             << ", \"local_search_moves\": " << metrics.num_local_search_moves
+             << ", \"construction_time\": " << metrics.construction_time
+             << ", \"pheromon_update_time\": " << metrics.pheromon_update_time
+             << ", \"local_search_time\": " << metrics.local_search_time
+             << ", \"update_solution_time\": " << metrics.update_solution_time
+             << ", \"commit_time\": " << metrics.commit_time
+             << ", \"best_score_before_arrivals\": " << metrics.best_score_before_arrivals
+             << ", \"best_score_after_arrivals\": " << metrics.best_score_after_arrivals << "}" << std::endl;
+    }
+}
+
+bool MetricsSink::parse_format(const std::string &name, MetricsFormat &format)
+{
+    if (name == "jsonl")
+    {
+        format = MetricsFormat::JsonLines;
+    }
+    else if (name == "csv")
+    {
+        format = MetricsFormat::Csv;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
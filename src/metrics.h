@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+
+enum class MetricsFormat
+{
+    JsonLines, // one JSON object per line
+    Csv        // a header line then one line per timeslice
+};
+
+// What happened during one timeslice of the working day
+struct TimesliceMetrics
+{
+    unsigned int timeslice = 0;
+    unsigned long num_steps = 0;
+    unsigned long num_ants_built = 0;
+    unsigned long num_ants_stuck = 0;
+    // Mean number of candidates an ant chose its next node among
+    double average_candidates = 0;
+    unsigned int num_new_customers = 0;
+    unsigned long num_local_search_moves = 0;
+    // New customers inserted into the best solution, and ACS solutions constructed for the ones which didn't fit
+    unsigned long num_inserted_customers = 0;
+    unsigned long num_rebuild_attempts = 0;
+    // Customers no plan could serve, turned down at the end of the timeslice
+    unsigned int num_rejected_customers = 0;
+
+    // In seconds
+    double construction_time = 0;
+    double pheromon_update_time = 0;
+    double local_search_time = 0;
+    double update_solution_time = 0;
+    double commit_time = 0;
+
+    // Score of the best solution before and after the new customers were inserted
+    float best_score_before_arrivals = 0;
+    float best_score_after_arrivals = 0;
+};
+
+// Writes the metrics of every timeslice to a file, in the format chosen at runtime
+class MetricsSink
+{
+private:
+    std::ofstream file;
+    MetricsFormat format;
+
+public:
+    MetricsSink(const std::string &filename, MetricsFormat format);
+
+    bool is_open() const;
+    void write(const TimesliceMetrics &metrics);
+
+    static bool parse_format(const std::string &name, MetricsFormat &format);
+};
@@ -0,0 +1,296 @@
+#include "order_stream.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+OrderStream::OrderStream(const std::string &source, const std::string &commitments_path) : input_fd{-1}, listen_fd{-1}, client_fd{-1}, fifo_writer_fd{-1}, output_fd{-1}, open{false}
+{
+    if (pipe(wakeup_fds) != 0)
+    {
+        wakeup_fds[0] = wakeup_fds[1] = -1;
+        return;
+    }
+
+    if (source == "-")
+    {
+        input_fd = STDIN_FILENO;
+    }
+    else if (source.compare(0, 5, "unix:") == 0)
+    {
+        socket_path = source.substr(5);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path))
+        {
+            return;
+        }
+        std::strcpy(address.sun_path, socket_path.c_str());
+
+        // A socket left by a previous run would make bind fail
+        unlink(socket_path.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, 1) != 0)
+        {
+            return;
+        }
+    }
+    else
+    {
+        struct stat source_stat;
+        bool is_fifo = stat(source.c_str(), &source_stat) == 0 && S_ISFIFO(source_stat.st_mode);
+
+        // Opening a named pipe for reading blocks until there is a writer, unless we are the writer
+        input_fd = ::open(source.c_str(), O_RDONLY | (is_fifo ? O_NONBLOCK : 0));
+        if (input_fd < 0)
+        {
+            return;
+        }
+        if (is_fifo)
+        {
+            fifo_writer_fd = ::open(source.c_str(), O_WRONLY);
+        }
+    }
+
+    if (commitments_path == "-")
+    {
+        output_fd = STDOUT_FILENO;
+    }
+    else if (!commitments_path.empty())
+    {
+        output_fd = ::open(commitments_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output_fd < 0)
+        {
+            return;
+        }
+    }
+
+    open = true;
+    thread = std::thread(&OrderStream::reader_loop, this);
+}
+
+OrderStream::~OrderStream()
+{
+    if (thread.joinable())
+    {
+        char wakeup = 0;
+        if (write(wakeup_fds[1], &wakeup, 1) == 1)
+        {
+            thread.join();
+        }
+        else
+        {
+            thread.detach();
+        }
+    }
+
+    flush();
+
+    for (int fd : {input_fd, listen_fd, client_fd, fifo_writer_fd, wakeup_fds[0], wakeup_fds[1]})
+    {
+        if (fd > STDERR_FILENO)
+        {
+            close(fd);
+        }
+    }
+    if (output_fd > STDERR_FILENO)
+    {
+        close(output_fd);
+    }
+    if (listen_fd >= 0)
+    {
+        unlink(socket_path.c_str());
+    }
+}
+
+bool OrderStream::is_open() const
+{
+    return open;
+}
+
+void OrderStream::reader_loop()
+{
+    std::string text;
+    char buffer[4096];
+
+    while (true)
+    {
+        // The socket accepts a new client once the previous one has left
+        int fd = listen_fd >= 0 ? (client_fd >= 0 ? client_fd : listen_fd) : input_fd;
+        pollfd fds[2] = {{wakeup_fds[0], POLLIN, 0}, {fd, POLLIN, 0}};
+
+        if (poll(fds, fd >= 0 ? 2 : 1, -1) < 0)
+        {
+            continue;
+        }
+        if (fds[0].revents != 0)
+        {
+            return;
+        }
+        if (fds[1].revents == 0)
+        {
+            continue;
+        }
+
+        if (fd == listen_fd)
+        {
+            int new_client_fd = accept(listen_fd, nullptr, nullptr);
+            std::lock_guard<std::mutex> lock(mutex);
+            client_fd = new_client_fd;
+            continue;
+        }
+
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            continue;
+        }
+
+        if (size <= 0)
+        {
+            // The end of the stream : the client left, or there is nothing more to read
+            text.clear();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd == client_fd)
+            {
+                close(client_fd);
+                client_fd = -1;
+            }
+            else
+            {
+                if (input_fd > STDERR_FILENO)
+                {
+                    close(input_fd);
+                }
+                input_fd = -1;
+            }
+            continue;
+        }
+
+        text.append(buffer, size);
+
+        std::size_t line_begin = 0;
+        std::size_t line_end;
+        while ((line_end = text.find('\n', line_begin)) != std::string::npos)
+        {
+            parse_line(text.substr(line_begin, line_end - line_begin));
+            line_begin = line_end + 1;
+        }
+        text.erase(0, line_begin);
+    }
+}
+
+void OrderStream::parse_line(const std::string &line)
+{
+    std::istringstream iss(line);
+    StreamedOrder order;
+
+    if (!(iss >> order.id) || order.id[0] == '#')
+    {
+        return;
+    }
+
+    if (!(iss >> order.x >> order.y >> order.demand >> order.service_time))
+    {
+        std::cerr << "Malformed order : " << line << std::endl;
+        return;
+    }
+
+    // The time window is optional
+    float ready_time, due_date;
+    if (iss >> ready_time >> due_date)
+    {
+        order.ready_time = ready_time;
+        order.due_date = due_date;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending_orders.push_back(order);
+}
+
+std::vector<StreamedOrder> OrderStream::take_orders()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<StreamedOrder> orders;
+    orders.swap(pending_orders);
+
+    return orders;
+}
+
+void OrderStream::accept_order(unsigned int c_node_id, const StreamedOrder &order)
+{
+    if (c_node_id >= nodes_orders_ids.size())
+    {
+        nodes_orders_ids.resize(c_node_id + 1);
+    }
+    nodes_orders_ids[c_node_id] = order.id;
+}
+
+void OrderStream::reject_order(const StreamedOrder &order)
+{
+    replies += "reject " + order.id + "\n";
+}
+
+void OrderStream::reject_customer(unsigned int c_node_id)
+{
+    replies += "reject " + order_id(c_node_id) + "\n";
+}
+
+void OrderStream::write_commitment(unsigned int c_node_id, unsigned int vehicle_number)
+{
+    replies += "commit " + order_id(c_node_id) + " " + std::to_string(vehicle_number) + "\n";
+}
+
+const std::string &OrderStream::order_id(unsigned int c_node_id)
+{
+    if (c_node_id >= nodes_orders_ids.size())
+    {
+        nodes_orders_ids.resize(c_node_id + 1);
+    }
+    if (nodes_orders_ids[c_node_id].empty())
+    {
+        nodes_orders_ids[c_node_id] = std::to_string(c_node_id);
+    }
+
+    return nodes_orders_ids[c_node_id];
+}
+
+void OrderStream::flush()
+{
+    if (replies.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The replies go back to the client of the socket when there is one, a client which left loses them
+    if (listen_fd >= 0 && output_fd < 0)
+    {
+        if (client_fd >= 0)
+        {
+            send(client_fd, replies.data(), replies.size(), MSG_NOSIGNAL);
+        }
+    }
+    else if (output_fd >= 0)
+    {
+        for (std::size_t written = 0; written < replies.size();)
+        {
+            ssize_t size = write(output_fd, replies.data() + written, replies.size() - written);
+            if (size <= 0)
+            {
+                break;
+            }
+            written += size;
+        }
+    }
+
+    replies.clear();
+}
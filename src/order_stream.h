@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <limits>
+
+// An order received while the day is running, in the units of the dataset
+struct StreamedOrder
+{
+    std::string id;
+    float x = 0;
+    float y = 0;
+    int demand = 0;
+    float service_time = 0;
+    float ready_time = 0;
+    float due_date = std::numeric_limits<float>::infinity();
+};
+
+// Receives the orders of a live day on a background thread and writes back the commitments.
+// The orders are text lines "id x y demand service_time [ready_time due_date]", the empty lines and the lines
+// starting with # are skipped. They are read from stdin ("-"), a file or a named pipe, or from the clients of
+// a Unix domain socket ("unix:path"), one client at a time.
+// The commitments are written as "commit id vehicle_number", the orders which found no free slot or which no vehicle
+// could serve, and the customers no plan could serve, as "reject id", to the client of the socket or to the commitments file.
+// They are buffered until flush, once per timeslice.
+class OrderStream
+{
+private:
+    int input_fd;
+    int listen_fd;
+    int client_fd;
+    // Keeps a named pipe open for writing, so that the reader does not see the end of the stream between two writers
+    int fifo_writer_fd;
+    int output_fd;
+    // Written to by the destructor to wake the reader up
+    int wakeup_fds[2];
+    std::string socket_path;
+    bool open;
+
+    std::mutex mutex;
+    std::vector<StreamedOrder> pending_orders;
+    std::string replies;
+    std::thread thread;
+
+    // Order id of every customer node, the customers of the instance answer with their node id
+    std::vector<std::string> nodes_orders_ids;
+
+    void reader_loop();
+    void parse_line(const std::string &line);
+    const std::string &order_id(unsigned int c_node_id);
+
+public:
+    OrderStream(const std::string &source, const std::string &commitments_path);
+    ~OrderStream();
+
+    OrderStream(const OrderStream &) = delete;
+    OrderStream &operator=(const OrderStream &) = delete;
+
+    bool is_open() const;
+
+    // Returns the orders received since the last call, never blocks
+    std::vector<StreamedOrder> take_orders();
+    // The order became the customer c_node_id of the problem
+    void accept_order(unsigned int c_node_id, const StreamedOrder &order);
+    void reject_order(const StreamedOrder &order);
+    // The customer c_node_id was turned down by Problem::reject after it had been accepted
+    void reject_customer(unsigned int c_node_id);
+    void write_commitment(unsigned int c_node_id, unsigned int vehicle_number);
+    void flush();
+};
@@ -0,0 +1,363 @@
+#include "pheromone_store.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace
+{
+const unsigned int no_slot = std::numeric_limits<unsigned int>::max();
+}
+
+PheromoneStore::PheromoneStore(const Problem *problem, float alpha, float beta, bool sparse) : problem{problem}, alpha{alpha}, beta{beta}, sparse{sparse}, num_neighbours{0}, hash_size{0}, hash_shift{0}, default_tau{0}, default_tau_alpha{0}, selection_kernel{get_selection_kernel()}
+{
+    num_rows = problem->get_num_nodes() + 1;
+
+    // Without candidate lists there is nothing to key the sparse rows on
+    if (problem->get_num_neighbours() == 0)
+    {
+        this->sparse = false;
+    }
+
+    if (!this->sparse)
+    {
+        row_size = num_rows;
+
+        // The heuristic part of the choice info only depends on the distances so it is computed once
+        heuristic = std::vector<float>((std::size_t)num_rows * row_size);
+        for (auto i = 0; i < num_rows; i++)
+        {
+            for (auto j = 0; j < num_rows; j++)
+            {
+                heuristic[(std::size_t)i * row_size + j] = compute_heuristic(i, j);
+            }
+        }
+    }
+    else
+    {
+        num_neighbours = problem->get_num_neighbours();
+        row_size = num_neighbours + 1;
+
+        // The hash tables are kept at most half full so that the probes stay short
+        hash_size = 4;
+        hash_shift = 30;
+        while (hash_size < 2 * num_neighbours)
+        {
+            hash_size *= 2;
+            hash_shift--;
+        }
+
+        heuristic = std::vector<float>((std::size_t)num_rows * row_size, 0);
+        slots_node_ids = std::vector<unsigned int>((std::size_t)num_rows * num_neighbours, 0);
+        hash_keys = std::vector<unsigned int>((std::size_t)num_rows * hash_size, 0);
+        hash_slots = std::vector<uint16_t>((std::size_t)num_rows * hash_size, 0);
+
+        // The depot slot, all the depots are at the same place so we take the first one
+        unsigned int depot_node_id = problem->get_num_customers() + 1;
+        for (auto i = 0; i < num_rows; i++)
+        {
+            heuristic[(std::size_t)i * row_size + num_neighbours] = compute_heuristic(i, depot_node_id);
+        }
+    }
+
+    tau = std::vector<float>((std::size_t)num_rows * row_size, 0);
+    choice_info = std::vector<float>((std::size_t)num_rows * row_size, 0);
+    rows_epochs = std::vector<std::atomic<unsigned int>>(num_rows);
+}
+
+void PheromoneStore::reset(float tau_0)
+{
+    std::fill(tau.begin(), tau.end(), tau_0);
+
+    // Every row is up to date with an empty journal
+    events.clear();
+    reset_nodes_ids.clear();
+    for (auto &row_epoch : rows_epochs)
+    {
+        row_epoch.store(0, std::memory_order_relaxed);
+    }
+
+    if (sparse)
+    {
+        default_tau = tau_0;
+        default_tau_alpha = pow(default_tau, alpha);
+
+        // Every arc has tau_0 so the rows can be keyed on the lists as if they were new
+        std::fill(slots_node_ids.begin(), slots_node_ids.end(), 0);
+        std::fill(hash_keys.begin(), hash_keys.end(), 0);
+        refresh_neighbours();
+    }
+
+    for (std::size_t index = 0; index < choice_info.size(); index++)
+    {
+        update_choice_info(index);
+    }
+}
+
+float PheromoneStore::get(unsigned int node_id_i, unsigned int node_id_j) const
+{
+    catch_up_row(node_id_i);
+
+    if (!sparse)
+    {
+        return tau[(std::size_t)node_id_i * row_size + node_id_j];
+    }
+
+    unsigned int slot = find_slot(node_id_i, node_id_j);
+
+    return slot == no_slot ? default_tau : tau[(std::size_t)node_id_i * row_size + slot];
+}
+
+void PheromoneStore::update(unsigned int node_id_i, unsigned int node_id_j, float rho, float value)
+{
+    unsigned int slot = sparse ? find_slot(node_id_i, node_id_j) : node_id_j;
+
+    if (slot == no_slot)
+    {
+        return;
+    }
+
+    catch_up_row(node_id_i);
+    std::size_t index = (std::size_t)node_id_i * row_size + slot;
+    tau[index] *= (1. - rho);
+    tau[index] += rho * value;
+    update_choice_info(index);
+}
+
+void PheromoneStore::evaporate(float rho, float value)
+{
+    // The rows apply it when they catch up, only the default pheromon is evaporated now
+    events.push_back({rho, value, 0, 0});
+
+    default_tau *= (1. - rho);
+    default_tau += rho * value;
+    default_tau_alpha = pow(default_tau, alpha);
+}
+
+void PheromoneStore::reset_nodes(const std::vector<unsigned int> &nodes_ids, float value)
+{
+    if (nodes_ids.empty())
+    {
+        return;
+    }
+
+    // The arcs towards the nodes are reset in the other rows when they catch up
+    unsigned int nodes_begin = reset_nodes_ids.size();
+    reset_nodes_ids.insert(reset_nodes_ids.end(), nodes_ids.begin(), nodes_ids.end());
+    events.push_back({0, value, nodes_begin, (unsigned int)reset_nodes_ids.size()});
+
+    // The rows of the nodes are overwritten entirely, there is no need to catch them up
+    // A streamed customer took the slot of a placeholder node, so the heuristic of its arcs is computed again ;
+    // the other rows see the new column when they catch up (the sparse rows got it from refresh_neighbours)
+    unsigned int depot_node_id = problem->get_num_customers() + 1;
+    for (auto &node_id : nodes_ids)
+    {
+        bool moved = problem->is_streamed_customer(node_id);
+        std::size_t row_begin = (std::size_t)node_id * row_size;
+        for (auto slot = 0; slot < row_size; slot++)
+        {
+            if (moved && !sparse)
+            {
+                heuristic[row_begin + slot] = compute_heuristic(node_id, slot);
+                heuristic[(std::size_t)slot * row_size + node_id] = compute_heuristic(slot, node_id);
+            }
+            else if (moved && slot == num_neighbours)
+            {
+                heuristic[row_begin + slot] = compute_heuristic(node_id, depot_node_id);
+            }
+
+            tau[row_begin + slot] = value;
+            update_choice_info(row_begin + slot);
+        }
+        rows_epochs[node_id].store(events.size(), std::memory_order_relaxed);
+    }
+}
+
+void PheromoneStore::refresh_neighbours()
+{
+    if (!sparse)
+    {
+        return;
+    }
+
+    std::vector<float> new_tau(num_neighbours);
+
+    for (auto i = 0; i < num_rows; i++)
+    {
+        // The new slots start from the default pheromon, which is already up to date
+        catch_up_row(i);
+
+        const std::vector<unsigned int> &neighbours = problem->get_neighbours(i);
+        std::size_t row_begin = (std::size_t)i * row_size;
+        unsigned int *row_node_ids = slots_node_ids.data() + (std::size_t)i * num_neighbours;
+
+        // We read the pheromons of the arcs which stay before the old slots are overwritten
+        for (auto slot = 0; slot < neighbours.size(); slot++)
+        {
+            unsigned int old_slot = find_slot(i, neighbours[slot]);
+            new_tau[slot] = old_slot == no_slot ? default_tau : tau[row_begin + old_slot];
+        }
+
+        for (auto slot = 0; slot < num_neighbours; slot++)
+        {
+            std::size_t index = row_begin + slot;
+
+            if (slot < neighbours.size())
+            {
+                row_node_ids[slot] = neighbours[slot];
+                tau[index] = new_tau[slot];
+                heuristic[index] = compute_heuristic(i, neighbours[slot]);
+            }
+            else
+            {
+                row_node_ids[slot] = 0;
+                tau[index] = default_tau;
+                heuristic[index] = 0;
+            }
+            update_choice_info(index);
+        }
+
+        build_row_hash(i);
+    }
+}
+
+void PheromoneStore::gather_choice_info(unsigned int node_id_i, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights) const
+{
+    catch_up_row(node_id_i);
+
+    if (!sparse)
+    {
+        selection_kernel.gather_weights(choice_info.data() + (std::size_t)node_id_i * row_size, candidate_nodes_ids, num_candidates, weights);
+        return;
+    }
+
+    const float *row_choice_info = choice_info.data() + (std::size_t)node_id_i * row_size;
+
+    for (auto k = 0; k < num_candidates; k++)
+    {
+        unsigned int slot = find_slot(node_id_i, candidate_nodes_ids[k]);
+        weights[k] = slot == no_slot ? default_tau_alpha * compute_heuristic(node_id_i, candidate_nodes_ids[k]) : row_choice_info[slot];
+    }
+}
+
+bool PheromoneStore::is_sparse() const
+{
+    return sparse;
+}
+
+std::size_t PheromoneStore::get_memory_usage() const
+{
+    return (tau.size() + heuristic.size() + choice_info.size()) * sizeof(float) +
+           (slots_node_ids.size() + hash_keys.size() + rows_epochs.size()) * sizeof(unsigned int) +
+           hash_slots.size() * sizeof(uint16_t);
+}
+
+unsigned int PheromoneStore::find_slot(unsigned int node_id_i, unsigned int node_id_j) const
+{
+    // Every depot shares the last slot of the row
+    if (node_id_j > problem->get_num_customers())
+    {
+        return num_neighbours;
+    }
+
+    // Fibonacci hashing with linear probing, an empty key (0 is never a customer) ends the probe
+    const unsigned int *row_keys = hash_keys.data() + (std::size_t)node_id_i * hash_size;
+    unsigned int h = (node_id_j * 2654435769u) >> hash_shift;
+
+    while (row_keys[h] != 0)
+    {
+        if (row_keys[h] == node_id_j)
+        {
+            return hash_slots[(std::size_t)node_id_i * hash_size + h];
+        }
+        h = (h + 1) & (hash_size - 1);
+    }
+
+    return no_slot;
+}
+
+void PheromoneStore::build_row_hash(unsigned int node_id_i)
+{
+    unsigned int *row_keys = hash_keys.data() + (std::size_t)node_id_i * hash_size;
+    uint16_t *row_slots = hash_slots.data() + (std::size_t)node_id_i * hash_size;
+    const unsigned int *row_node_ids = slots_node_ids.data() + (std::size_t)node_id_i * num_neighbours;
+
+    std::fill(row_keys, row_keys + hash_size, 0);
+
+    for (auto slot = 0; slot < num_neighbours && row_node_ids[slot] != 0; slot++)
+    {
+        unsigned int h = (row_node_ids[slot] * 2654435769u) >> hash_shift;
+        while (row_keys[h] != 0)
+        {
+            h = (h + 1) & (hash_size - 1);
+        }
+
+        row_keys[h] = row_node_ids[slot];
+        row_slots[h] = slot;
+    }
+}
+
+void PheromoneStore::catch_up_row(unsigned int node_id_i) const
+{
+    // The journal only grows between the steps, while no ant is reading it
+    unsigned int num_events = events.size();
+    if (rows_epochs[node_id_i].load(std::memory_order_acquire) == num_events)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(rows_mutexes[node_id_i % rows_mutexes.size()]);
+
+    // Another ant may have caught the row up while we were waiting
+    unsigned int epoch = rows_epochs[node_id_i].load(std::memory_order_relaxed);
+    if (epoch == num_events)
+    {
+        return;
+    }
+
+    // The events are applied in turn, so a row ends up exactly as if they had been applied to the whole matrix
+    std::size_t row_begin = (std::size_t)node_id_i * row_size;
+    for (; epoch < num_events; epoch++)
+    {
+        const Event &event = events[epoch];
+
+        if (event.nodes_begin == event.nodes_end)
+        {
+            for (std::size_t index = row_begin; index < row_begin + row_size; index++)
+            {
+                tau[index] *= (1. - event.rho);
+                tau[index] += event.rho * event.value;
+            }
+        }
+        else
+        {
+            for (auto k = event.nodes_begin; k < event.nodes_end; k++)
+            {
+                unsigned int slot = sparse ? find_slot(node_id_i, reset_nodes_ids[k]) : reset_nodes_ids[k];
+                if (slot != no_slot)
+                {
+                    tau[row_begin + slot] = event.value;
+                }
+            }
+        }
+    }
+
+    for (std::size_t index = row_begin; index < row_begin + row_size; index++)
+    {
+        update_choice_info(index);
+    }
+
+    rows_epochs[node_id_i].store(num_events, std::memory_order_release);
+}
+
+void PheromoneStore::update_choice_info(std::size_t index) const
+{
+    choice_info[index] = pow(tau[index], alpha) * heuristic[index];
+}
+
+float PheromoneStore::compute_heuristic(unsigned int node_id_i, unsigned int node_id_j) const
+{
+    float eta_ij = (float)1 / problem->get_distance(node_id_i, node_id_j);
+
+    return pow(eta_ij, beta);
+}
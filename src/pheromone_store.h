@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include "problem.h"
+#include "selection_kernel.h"
+
+// Pheromons of the arcs together with the cached choice info tau^alpha * eta^beta read by the ants
+//
+// Dense layout : one (num_nodes + 1) x (num_nodes + 1) matrix for each of tau, eta^beta and the choice info.
+// Sparse layout : every row only stores the arcs towards the candidate list of its node (Problem::get_neighbours)
+//                 plus one arc shared by all the depots (they all are at the same place).
+//                 A small open addressing table per row finds the slot of an arc in O(1).
+//                 The arcs which are not stored all have the default pheromon, which follows the evaporations
+//                 but ignores the local and global updates.
+//
+// The evaporations and the resets of the dynamic events are not applied to the whole matrix : they are journaled,
+// and every row records how many events it has seen. A row is brought up to date the next time it is read or updated,
+// so an event costs O(size of the rows of the new nodes) and the rows nobody reads are never touched.
+class PheromoneStore
+{
+private:
+    const Problem *problem;
+    float alpha;
+    float beta;
+    bool sparse;
+
+    unsigned int num_rows;
+    unsigned int row_size; // num_rows when dense, num_neighbours + 1 (the depot slot) when sparse
+
+    // A dynamic event : an evaporation when nodes_begin == nodes_end, otherwise the arcs towards
+    // reset_nodes_ids[nodes_begin, nodes_end) are set to value
+    struct Event
+    {
+        float rho;
+        float value;
+        unsigned int nodes_begin;
+        unsigned int nodes_end;
+    };
+
+    // The rows are brought up to date by their readers, the ants read them from several threads
+    mutable std::vector<float> tau;
+    std::vector<float> heuristic;
+    mutable std::vector<float> choice_info;
+
+    std::vector<Event> events;
+    std::vector<unsigned int> reset_nodes_ids;
+    // Number of events applied to every row
+    mutable std::vector<std::atomic<unsigned int>> rows_epochs;
+    mutable std::array<std::mutex, 64> rows_mutexes;
+
+    // Sparse layout only
+    unsigned int num_neighbours;
+    unsigned int hash_size;
+    unsigned int hash_shift;
+    std::vector<unsigned int> slots_node_ids; // num_rows x num_neighbours, 0 for an empty slot
+    std::vector<unsigned int> hash_keys;      // num_rows x hash_size, node id or 0
+    std::vector<uint16_t> hash_slots;         // num_rows x hash_size
+    float default_tau;
+    float default_tau_alpha;
+
+    const SelectionKernel &selection_kernel;
+
+    unsigned int find_slot(unsigned int node_id_i, unsigned int node_id_j) const;
+    void build_row_hash(unsigned int node_id_i);
+    void catch_up_row(unsigned int node_id_i) const;
+    void update_choice_info(std::size_t index) const;
+    float compute_heuristic(unsigned int node_id_i, unsigned int node_id_j) const;
+
+public:
+    PheromoneStore(const Problem *problem, float alpha, float beta, bool sparse);
+
+    // Sets every arc to tau_0
+    void reset(float tau_0);
+
+    float get(unsigned int node_id_i, unsigned int node_id_j) const;
+
+    // tau_ij = (1 - rho) * tau_ij + rho * value on one arc, does nothing on an arc which is not stored
+    void update(unsigned int node_id_i, unsigned int node_id_j, float rho, float value);
+
+    // tau = (1 - rho) * tau + rho * value on every arc
+    void evaporate(float rho, float value);
+
+    // Sets every arc from or towards the nodes to value, the other arcs keep their pheromon
+    void reset_nodes(const std::vector<unsigned int> &nodes_ids, float value);
+
+    // Re-keys the sparse rows on the candidate lists after Problem::update recomputed them
+    // The arcs which stay in a list keep their pheromon, the new ones start from the default pheromon
+    void refresh_neighbours();
+
+    // weights[k] = choice info of the arc (node_id_i, candidate_nodes_ids[k])
+    void gather_choice_info(unsigned int node_id_i, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights) const;
+
+    bool is_sparse() const;
+    std::size_t get_memory_usage() const;
+};
@@ -1,51 +1,177 @@
 #include "problem.h"
 
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <map>
 #include <iostream>
-#include <math.h>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
 
-Node::Node(unsigned int id, float x, float y, bool is_depot, float available_time, int demand, float service_time) : id{id}, x{x}, y{y}, is_depot{is_depot}, available_time{available_time}, demand{demand}, service_time{service_time} {};
+namespace
+{
+// Cursor over one line of the text of an instance, the numbers are parsed in place without copying the line
+struct LineCursor
+{
+    const char *current;
+    const char *end;
+
+    LineCursor(const char *begin, const char *end) : current{begin}, end{end} {}
+
+    // Moves to the next number, returns false if there is none left on the line
+    bool skip_blanks()
+    {
+        while (current < end && (*current == ' ' || *current == '\t' || *current == '\r'))
+        {
+            current++;
+        }
+        return current < end;
+    }
+
+    bool parse(unsigned int &value)
+    {
+        char *next;
+        if (!skip_blanks())
+        {
+            return false;
+        }
+        value = std::strtoul(current, &next, 10);
+        return advance(next);
+    }
+
+    bool parse(float &value)
+    {
+        char *next;
+        if (!skip_blanks())
+        {
+            return false;
+        }
+        value = std::strtof(current, &next);
+        return advance(next);
+    }
+
+    bool advance(const char *next)
+    {
+        if (next == current || next > end)
+        {
+            return false;
+        }
+        current = next;
+        return true;
+    }
+};
 
-Problem::Problem(std::string filepath, unsigned int t_wd, unsigned int n_ts) : t_wd{t_wd}, n_ts{n_ts}
+// Returns the line starting at begin and moves begin to the start of the next one
+LineCursor next_line(const char *&begin, const char *end)
 {
-    std::ifstream infile(filepath);
-    std::string line;
+    const char *line_end = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+    if (line_end == nullptr)
+    {
+        line_end = end;
+    }
 
-    std::getline(infile, dataset_name);
+    LineCursor line(begin, line_end);
+    begin = line_end < end ? line_end + 1 : end;
 
-    std::getline(infile, line);
-    std::getline(infile, line);
-    std::getline(infile, line);
+    return line;
+}
+} // namespace
 
-    std::getline(infile, line);
-    std::istringstream iss(line);
-    iss >> num_vehicles >> vehicle_capacity;
+Problem::Problem(std::string filepath, unsigned int t_wd, unsigned int n_ts, const ProblemOptions &options) : num_neighbours{options.num_neighbours}, num_local_search_neighbours{options.num_local_search_neighbours}, time_windows{options.time_windows}, filepath{filepath}, t_wd{t_wd}, n_ts{n_ts}
+{
+    // A compiled instance already holds the scaled nodes and maybe the distances, we only map it
+    if (is_instance_cache(filepath))
+    {
+        load_cache(options);
+    }
+    else
+    {
+        load_text(options);
+    }
 
-    std::getline(infile, line);
-    std::getline(infile, line);
-    std::getline(infile, line);
-    std::getline(infile, line);
+    neighbours = std::vector<std::vector<unsigned int>>(nodes_x.size());
+    local_search_neighbours = std::vector<std::vector<unsigned int>>(num_neighbours == 0 ? nodes_x.size() : 0);
+    committed_c_nodes = std::vector<bool>(nodes_x.size(), false);
+    commitments_end_of_service = std::vector<float>(nodes_x.size(), 0);
+    rejected_c_nodes = std::vector<bool>(nodes_x.size(), false);
+
+    // We queue all the nodes (depots included) by the time they become available, the stream slots are queued
+    // when add_customer fills them
+    // The sort is stable so that the nodes available at the same time come in id order
+    arrivals.reserve(nodes_x.size() - 1);
+    for (auto i = 1; i < nodes_x.size(); i++)
+    {
+        if (i < first_stream_slot || i >= stream_slots_end)
+        {
+            arrivals.push_back(i);
+        }
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [this](unsigned int node_id_a, unsigned int node_id_b) {
+        return nodes_available_time[node_id_a] < nodes_available_time[node_id_b];
+    });
+    next_arrival = 0;
+
+    available_nodes_ids.reserve(arrivals.size());
+    available_c_nodes_ids.reserve(num_customers);
+    available_c_nodes_ids_by_demand.reserve(num_customers);
+
+    // We initialize the vehicles_commitments
+    vehicles_commitments = std::vector<std::vector<unsigned int>>(num_vehicles + 1);
+
+    last_update_time = -1;
+}
+
+void Problem::load_text(const ProblemOptions &options)
+{
+    // We read the whole file at once and parse the numbers in place
+    std::ifstream infile(filepath, std::ios::binary);
+    std::string text;
+    infile.seekg(0, std::ios::end);
+    text.resize(std::max<std::streamoff>(0, infile.tellg()));
+    infile.seekg(0, std::ios::beg);
+    infile.read(&text[0], text.size());
+
+    const char *current = text.data();
+    const char *end = text.data() + text.size();
+
+    LineCursor name_line = next_line(current, end);
+    dataset_name = std::string(name_line.current, name_line.end);
+    if (!dataset_name.empty() && dataset_name.back() == '\r')
+    {
+        dataset_name.pop_back();
+    }
+
+    next_line(current, end);
+    next_line(current, end);
+    next_line(current, end);
+
+    LineCursor vehicles_line = next_line(current, end);
+    vehicles_line.parse(num_vehicles);
+    vehicles_line.parse(vehicle_capacity);
+
+    next_line(current, end);
+    next_line(current, end);
+    next_line(current, end);
+    next_line(current, end);
 
     unsigned int depot_due_date;
     unsigned int counter = 0;
 
-    while (std::getline(infile, line))
+    while (current < end)
     {
-        std::istringstream iss(line);
+        LineCursor line = next_line(current, end);
         unsigned int number, demand, ready_time, due_date;
         float x_coord, y_coord, service_time, available_time;
-        if (!(iss >> number >> x_coord >> y_coord >> demand >> ready_time >> due_date >> service_time >> available_time))
+        if (!(line.parse(number) && line.parse(x_coord) && line.parse(y_coord) && line.parse(demand) &&
+              line.parse(ready_time) && line.parse(due_date) && line.parse(service_time) && line.parse(available_time)))
         {
             break;
         }
-        Node *node = new Node(number, x_coord, y_coord, false, available_time, demand, service_time);
-
-        nodes.push_back(node);
+        // The dataset numbers its nodes from 0 in order, so the node id is the position in the arrays
+        add_node(x_coord, y_coord, false, available_time, demand, service_time, ready_time, due_date);
 
         if (counter == 0)
         {
@@ -56,94 +182,383 @@ Problem::Problem(std::string filepath, unsigned int t_wd, unsigned int n_ts) : t
         counter++;
     }
 
+    // The stream slots wait at the depot until a customer takes them
+    first_stream_slot = nodes_x.size();
+    next_stream_slot = first_stream_slot;
+    for (auto i = 0; i < options.stream_capacity; i++)
+    {
+        add_node(nodes_x[0], nodes_y[0], false, std::numeric_limits<float>::infinity(), 0, 0, 0, depot_due_date);
+    }
+    stream_slots_end = nodes_x.size();
+
     // Get the number of customers
-    num_customers = nodes.size() - 1;
+    num_customers = nodes_x.size() - 1;
 
-    // We scale the (x, y, service_time, available_time) so they fit in our day length
+    // We scale the (x, y, service_time, available_time, ready_time, due_date) so they fit in our day length
     scaling_factor = (float)t_wd / (float)depot_due_date;
-    for (auto &node : nodes)
+    for (auto i = 0; i < nodes_x.size(); i++)
     {
-        node->x *= scaling_factor;
-        node->y *= scaling_factor;
-        node->available_time *= scaling_factor;
-        node->service_time *= scaling_factor;
+        nodes_x[i] *= scaling_factor;
+        nodes_y[i] *= scaling_factor;
+        nodes_available_time[i] *= scaling_factor;
+        nodes_service_time[i] *= scaling_factor;
+        nodes_ready_time[i] *= scaling_factor;
+        nodes_due_date[i] *= scaling_factor;
     }
 
     // We add depot duplicates (one for each vehicle)
-    float depot_x_coord = nodes[0]->x;
-    float depot_y_coord = nodes[0]->y;
+    float depot_x_coord = nodes_x[0];
+    float depot_y_coord = nodes_y[0];
 
     for (auto i = 1; i <= num_vehicles; i++)
     {
-        Node *node = new Node(num_customers + i, depot_x_coord, depot_y_coord, true, 0, 0, 0);
-        nodes.push_back(node);
+        add_node(depot_x_coord, depot_y_coord, true, 0, 0, 0, 0, nodes_due_date[0]);
     }
 
-    // We build the entire distance matrix
-    for (auto i = 0; i < nodes.size(); i++)
+    // We build the distances with the backend that fits in the memory budget
+    distance_oracle.build(nodes_x, nodes_y, options.distance_backend, options.distance_memory_budget, options.num_threads);
+}
+
+void Problem::load_cache(const ProblemOptions &options)
+{
+    instance_cache = std::unique_ptr<MappedFile>(new MappedFile(filepath));
+
+    InstanceCacheHeader header;
+    if (instance_cache->get_size() < sizeof(header))
+    {
+        throw std::runtime_error(filepath + " is not a valid instance cache");
+    }
+    std::memcpy(&header, instance_cache->get_data(), sizeof(header));
+
+    if (header.version != instance_cache_version)
+    {
+        throw std::runtime_error(filepath + " was written by another version of the instance cache");
+    }
+    if (header.t_wd != t_wd)
+    {
+        throw std::runtime_error(filepath + " was compiled for a day length of " + std::to_string(header.t_wd));
+    }
+    // The stream slots would change the node ids the cache was compiled with
+    if (options.stream_capacity > 0)
+    {
+        throw std::runtime_error("Streamed customers need a text instance, " + filepath + " is an instance cache");
+    }
+
+    num_customers = header.num_customers;
+    first_stream_slot = num_customers + 1;
+    next_stream_slot = first_stream_slot;
+    stream_slots_end = num_customers + 1;
+    num_vehicles = header.num_vehicles;
+    vehicle_capacity = header.vehicle_capacity;
+    scaling_factor = header.scaling_factor;
+
+    std::size_t num_nodes = header.num_nodes;
+    const char *name = instance_cache->get_section(header.dataset_name_offset, header.dataset_name_size);
+    const char *x = instance_cache->get_section(header.x_offset, num_nodes * sizeof(float));
+    const char *y = instance_cache->get_section(header.y_offset, num_nodes * sizeof(float));
+    const char *service_time = instance_cache->get_section(header.service_time_offset, num_nodes * sizeof(float));
+    const char *available_time = instance_cache->get_section(header.available_time_offset, num_nodes * sizeof(float));
+    const char *demand = instance_cache->get_section(header.demand_offset, num_nodes * sizeof(int32_t));
+    const char *ready_time = instance_cache->get_section(header.ready_time_offset, num_nodes * sizeof(float));
+    const char *due_date = instance_cache->get_section(header.due_date_offset, num_nodes * sizeof(float));
+    const char *distances = instance_cache->get_section(header.distances_offset, header.distances_size);
+
+    if (!name || !x || !y || !service_time || !available_time || !demand || !ready_time || !due_date || !distances ||
+        num_nodes != num_customers + num_vehicles + 1)
+    {
+        throw std::runtime_error(filepath + " is truncated");
+    }
+
+    dataset_name = std::string(name, header.dataset_name_size);
+
+    // The node arrays are small next to the distances, we copy them so that the problem can grow
+    nodes_x.assign(reinterpret_cast<const float *>(x), reinterpret_cast<const float *>(x) + num_nodes);
+    nodes_y.assign(reinterpret_cast<const float *>(y), reinterpret_cast<const float *>(y) + num_nodes);
+    nodes_service_time.assign(reinterpret_cast<const float *>(service_time), reinterpret_cast<const float *>(service_time) + num_nodes);
+    nodes_available_time.assign(reinterpret_cast<const float *>(available_time), reinterpret_cast<const float *>(available_time) + num_nodes);
+    nodes_demand.assign(reinterpret_cast<const int32_t *>(demand), reinterpret_cast<const int32_t *>(demand) + num_nodes);
+    nodes_ready_time.assign(reinterpret_cast<const float *>(ready_time), reinterpret_cast<const float *>(ready_time) + num_nodes);
+    nodes_due_date.assign(reinterpret_cast<const float *>(due_date), reinterpret_cast<const float *>(due_date) + num_nodes);
+    nodes_is_depot.assign(num_nodes, false);
+    std::fill(nodes_is_depot.begin() + num_customers + 1, nodes_is_depot.end(), true);
+
+    // The stored table is used in place unless another backend has been asked for
+    auto stored_backend = static_cast<DistanceBackend>(header.distance_backend);
+    bool use_stored_table = stored_backend != DistanceBackend::OnTheFly &&
+                            header.distances_size == DistanceOracle::required_memory(num_nodes, stored_backend) &&
+                            (options.distance_backend == DistanceBackend::Automatic || options.distance_backend == stored_backend);
+
+    if (use_stored_table)
+    {
+        distance_oracle.attach(nodes_x, nodes_y, stored_backend, distances);
+    }
+    else
+    {
+        distance_oracle.build(nodes_x, nodes_y, options.distance_backend, options.distance_memory_budget, options.num_threads);
+    }
+}
+
+bool Problem::write_cache(const std::string &filename) const
+{
+    // Every section starts on 8 bytes so that the mapped arrays are aligned
+    auto align = [](uint64_t offset) { return (offset + 7) & ~(uint64_t)7; };
+
+    std::size_t num_nodes = nodes_x.size();
+    InstanceCacheHeader header = {};
+    std::memcpy(header.magic, instance_cache_magic, sizeof(header.magic));
+    header.version = instance_cache_version;
+    header.t_wd = t_wd;
+    header.num_customers = num_customers;
+    header.num_vehicles = num_vehicles;
+    header.vehicle_capacity = vehicle_capacity;
+    header.scaling_factor = scaling_factor;
+    header.num_nodes = num_nodes;
+    header.distance_backend = static_cast<uint32_t>(distance_oracle.get_backend());
+
+    header.dataset_name_offset = align(sizeof(header));
+    header.dataset_name_size = dataset_name.size();
+    header.x_offset = align(header.dataset_name_offset + header.dataset_name_size);
+    header.y_offset = align(header.x_offset + num_nodes * sizeof(float));
+    header.service_time_offset = align(header.y_offset + num_nodes * sizeof(float));
+    header.available_time_offset = align(header.service_time_offset + num_nodes * sizeof(float));
+    header.demand_offset = align(header.available_time_offset + num_nodes * sizeof(float));
+    header.ready_time_offset = align(header.demand_offset + num_nodes * sizeof(int32_t));
+    header.due_date_offset = align(header.ready_time_offset + num_nodes * sizeof(float));
+    header.distances_offset = align(header.due_date_offset + num_nodes * sizeof(float));
+    header.distances_size = distance_oracle.get_table_size();
+
+    std::ofstream cache_file(filename, std::ios::binary | std::ios::trunc);
+
+    auto write_section = [&cache_file](uint64_t offset, const void *data, std::size_t size) {
+        // We pad up to the offset of the section
+        static const char padding[8] = {};
+        cache_file.write(padding, offset - cache_file.tellp());
+        cache_file.write(static_cast<const char *>(data), size);
+    };
+
+    std::vector<int32_t> demand(nodes_demand.begin(), nodes_demand.end());
+
+    cache_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_section(header.dataset_name_offset, dataset_name.data(), dataset_name.size());
+    write_section(header.x_offset, nodes_x.data(), num_nodes * sizeof(float));
+    write_section(header.y_offset, nodes_y.data(), num_nodes * sizeof(float));
+    write_section(header.service_time_offset, nodes_service_time.data(), num_nodes * sizeof(float));
+    write_section(header.available_time_offset, nodes_available_time.data(), num_nodes * sizeof(float));
+    write_section(header.demand_offset, demand.data(), num_nodes * sizeof(int32_t));
+    write_section(header.ready_time_offset, nodes_ready_time.data(), num_nodes * sizeof(float));
+    write_section(header.due_date_offset, nodes_due_date.data(), num_nodes * sizeof(float));
+    write_section(header.distances_offset, distance_oracle.get_table(), header.distances_size);
+
+    return (bool)cache_file;
+}
+
+void Problem::add_node(float x, float y, bool is_depot, float available_time, int demand, float service_time, float ready_time, float due_date)
+{
+    nodes_x.push_back(x);
+    nodes_y.push_back(y);
+    nodes_is_depot.push_back(is_depot);
+    nodes_available_time.push_back(available_time);
+    nodes_demand.push_back(demand);
+    nodes_service_time.push_back(service_time);
+    nodes_ready_time.push_back(ready_time);
+    nodes_due_date.push_back(due_date);
+}
+
+std::vector<unsigned int> Problem::update(float time)
+{
+    // The nodes are released in the order of the arrivals queue, so we only look at the nodes
+    // between the cursor and the first node that is not available yet
+    // The time of the updates never goes back, the nodes already released stay available
+    std::vector<unsigned int> diff;
+    auto num_available_nodes = available_nodes_ids.size();
+
+    while (next_arrival < arrivals.size() && nodes_available_time[arrivals[next_arrival]] <= time)
     {
-        for (auto j = 0; j < nodes.size(); j++)
+        unsigned int node_id = arrivals[next_arrival];
+        available_nodes_ids.push_back(node_id);
+
+        if (!nodes_is_depot[node_id])
         {
-            float distance = sqrt(pow((nodes[i]->x - nodes[j]->x), 2) + pow(nodes[i]->y - nodes[j]->y, 2));
-            distances.push_back(distance);
+            available_c_nodes_ids.push_back(node_id);
+            diff.push_back(node_id);
         }
+
+        next_arrival++;
     }
 
-    // We initialize the vehicles_commitments
-    for (auto i = 1; i <= num_vehicles; i++)
+    last_update_time = time;
+
+    // We merge the new customers into the ones sorted by demand instead of sorting them all again
+    auto by_demand = [this](unsigned int c_node_id_a, unsigned int c_node_id_b) { return nodes_demand[c_node_id_a] < nodes_demand[c_node_id_b]; };
+    auto num_sorted = available_c_nodes_ids_by_demand.size();
+    available_c_nodes_ids_by_demand.insert(available_c_nodes_ids_by_demand.end(), diff.begin(), diff.end());
+    std::stable_sort(available_c_nodes_ids_by_demand.begin() + num_sorted, available_c_nodes_ids_by_demand.end(), by_demand);
+    std::inplace_merge(available_c_nodes_ids_by_demand.begin(), available_c_nodes_ids_by_demand.begin() + num_sorted, available_c_nodes_ids_by_demand.end(), by_demand);
+
+    // The local search reads the candidate lists when there are some, otherwise the lists kept for it,
+    // so that every Local_search of the timeslice doesn't sort its own
+    auto &lists = num_neighbours > 0 ? neighbours : local_search_neighbours;
+    unsigned int list_size = num_neighbours > 0 ? num_neighbours : num_local_search_neighbours;
+
+    if (!diff.empty() && list_size > 0)
     {
-        vehicles_commitments[i] = {};
+        std::vector<unsigned int> new_nodes_ids(available_nodes_ids.begin() + num_available_nodes, available_nodes_ids.end());
+        update_neighbours(lists, list_size, new_nodes_ids, diff);
     }
 
-    last_update_time = -1;
+    return diff;
 }
 
-std::vector<unsigned int> Problem::update(float time)
+unsigned int Problem::add_customer(float x, float y, int demand, float service_time, float ready_time, float due_date, float available_time)
 {
-    available_nodes_ids.clear();
-    available_c_nodes_ids.clear();
+    if (next_stream_slot == stream_slots_end)
+    {
+        return 0;
+    }
 
-    std::vector<unsigned int> diff;
+    // The orders no vehicle could serve are refused before they take a slot
+    if (!std::isfinite(x) || !std::isfinite(y) || demand > (int)vehicle_capacity || !(ready_time <= due_date))
+    {
+        return 0;
+    }
 
-    for (auto i = 1; i < nodes.size(); i++)
+    if (time_windows)
     {
-        if (nodes[i]->available_time <= time)
+        // A vehicle leaving the depot when the customer is released must still reach it before its due date
+        unsigned int depot_node_id = num_customers + 1;
+        float dx = x * scaling_factor - nodes_x[depot_node_id];
+        float dy = y * scaling_factor - nodes_y[depot_node_id];
+        if (std::max(available_time, last_update_time) + std::sqrt(dx * dx + dy * dy) > due_date * scaling_factor)
         {
-            available_nodes_ids.push_back(nodes[i]->id);
+            return 0;
         }
     }
 
-    for (auto i = 1; i <= num_customers; i++)
+    unsigned int c_node_id = next_stream_slot++;
+    nodes_x[c_node_id] = x * scaling_factor;
+    nodes_y[c_node_id] = y * scaling_factor;
+    nodes_demand[c_node_id] = demand;
+    nodes_service_time[c_node_id] = service_time * scaling_factor;
+    nodes_ready_time[c_node_id] = ready_time * scaling_factor;
+    nodes_due_date[c_node_id] = due_date * scaling_factor;
+    nodes_available_time[c_node_id] = available_time;
+
+    // Only the row and the column of the slot are computed again
+    distance_oracle.move_node(c_node_id, nodes_x[c_node_id], nodes_y[c_node_id]);
+
+    // The customer is queued after the pending nodes available at the same time
+    auto position = std::upper_bound(arrivals.begin() + next_arrival, arrivals.end(), available_time, [this](float time, unsigned int node_id) {
+        return time < nodes_available_time[node_id];
+    });
+    arrivals.insert(position, c_node_id);
+
+    return c_node_id;
+}
+
+bool Problem::is_nearer(unsigned int node_id, unsigned int c_node_id_a, unsigned int c_node_id_b) const
+{
+    // The ties are broken by id so that the lists don't depend on the order the customers arrived in
+    float distance_a = get_distance(node_id, c_node_id_a);
+    float distance_b = get_distance(node_id, c_node_id_b);
+
+    return distance_a < distance_b || (distance_a == distance_b && c_node_id_a < c_node_id_b);
+}
+
+void Problem::update_neighbours(std::vector<std::vector<unsigned int>> &lists, unsigned int list_size, const std::vector<unsigned int> &new_nodes_ids, const std::vector<unsigned int> &new_c_nodes_ids)
+{
+    // The candidate lists only contain customers, the depots are always reachable and are handled by the ants
+    // The lists of the nodes which were already available only have to make room for the new customers,
+    // the new nodes get theirs from all the available customers
+    std::vector<bool> is_new_node(nodes_x.size(), false);
+    for (auto &node_id : new_nodes_ids)
+    {
+        is_new_node[node_id] = true;
+    }
+
+    for (auto &node_id : available_nodes_ids)
     {
-        if (nodes[i]->available_time <= time)
+        if (is_new_node[node_id])
         {
-            available_c_nodes_ids.push_back(nodes[i]->id);
+            continue;
         }
 
-        if (nodes[i]->available_time > last_update_time && nodes[i]->available_time <= time)
+        std::vector<unsigned int> &node_neighbours = lists[node_id];
+        for (auto &c_node_id : new_c_nodes_ids)
         {
-            diff.push_back(nodes[i]->id);
+            if (node_neighbours.size() == list_size && !is_nearer(node_id, c_node_id, node_neighbours.back()))
+            {
+                continue;
+            }
+
+            auto position = std::upper_bound(node_neighbours.begin(), node_neighbours.end(), c_node_id, [this, node_id](unsigned int c_node_id_a, unsigned int c_node_id_b) {
+                return is_nearer(node_id, c_node_id_a, c_node_id_b);
+            });
+            node_neighbours.insert(position, c_node_id);
+
+            if (node_neighbours.size() > list_size)
+            {
+                node_neighbours.pop_back();
+            }
         }
     }
 
-    last_update_time = time;
+    std::vector<unsigned int> sorted_c_nodes_ids = available_c_nodes_ids;
+    auto new_list_size = std::min<std::size_t>(list_size, sorted_c_nodes_ids.size());
 
-    return diff;
+    for (auto &node_id : new_nodes_ids)
+    {
+        // A node is not its own neighbour, so we sort one more element and drop it if needed
+        auto sorted_size = std::min<std::size_t>(new_list_size + 1, sorted_c_nodes_ids.size());
+        std::partial_sort(sorted_c_nodes_ids.begin(),
+                          sorted_c_nodes_ids.begin() + sorted_size,
+                          sorted_c_nodes_ids.end(),
+                          [this, node_id](unsigned int c_node_id_a, unsigned int c_node_id_b) {
+                              return is_nearer(node_id, c_node_id_a, c_node_id_b);
+                          });
+
+        std::vector<unsigned int> &node_neighbours = lists[node_id];
+        node_neighbours.clear();
+
+        for (auto i = 0; i < sorted_size && node_neighbours.size() < new_list_size; i++)
+        {
+            if (sorted_c_nodes_ids[i] != node_id)
+            {
+                node_neighbours.push_back(sorted_c_nodes_ids[i]);
+            }
+        }
+    }
 }
 
-void Problem::commit(unsigned int c_node_id, unsigned int vehicle_number)
+void Problem::commit(unsigned int c_node_id, unsigned int vehicle_number, float end_of_service)
 {
     // TODO : Add invariants
     // Node has not already been committed
 
-    vehicles_commitments.at(vehicle_number).push_back(c_node_id);
+    vehicles_commitments[vehicle_number].push_back(c_node_id);
     committed_c_nodes_ids.push_back(c_node_id);
+    committed_c_nodes[c_node_id] = true;
+    commitments_end_of_service[c_node_id] = end_of_service;
+}
+
+void Problem::reject(unsigned int c_node_id)
+{
+    // Rejections are rare, the available customers are simply searched
+    for (auto *ids : {&available_nodes_ids, &available_c_nodes_ids, &available_c_nodes_ids_by_demand})
+    {
+        auto position = std::find(ids->begin(), ids->end(), c_node_id);
+        if (position != ids->end())
+        {
+            ids->erase(position);
+        }
+    }
+
+    rejected_c_nodes[c_node_id] = true;
 }
 
 unsigned int Problem::get_num_nodes() const
 {
     // We remove 1 because the first node is a padding dummy
-    return nodes.size() - 1;
+    return nodes_x.size() - 1;
 }
 
 unsigned int Problem::get_num_available_nodes() const
@@ -151,31 +566,54 @@ unsigned int Problem::get_num_available_nodes() const
     return available_nodes_ids.size();
 }
 
-std::vector<unsigned int> Problem::get_available_nodes_ids() const
+const std::vector<unsigned int> &Problem::get_available_nodes_ids() const
 {
     return available_nodes_ids;
 }
 
-std::vector<unsigned int> Problem::get_available_c_nodes_ids() const
+const std::vector<unsigned int> &Problem::get_available_c_nodes_ids() const
 {
     return available_c_nodes_ids;
 }
 
-std::vector<unsigned int> Problem::get_committed_c_nodes_ids() const
+const std::vector<unsigned int> &Problem::get_committed_c_nodes_ids() const
 {
     return committed_c_nodes_ids;
 }
 
+const std::vector<unsigned int> &Problem::get_available_c_nodes_ids_by_demand() const
+{
+    return available_c_nodes_ids_by_demand;
+}
+
 float Problem::get_distance(unsigned int node_id_i, unsigned int node_id_j) const
 {
-    //std::cout << "Problem::get_distance" << std::endl;
-    return distances.at(node_id_i * nodes.size() + node_id_j);
+    return distance_oracle.get(node_id_i, node_id_j);
+}
+
+const std::vector<unsigned int> &Problem::get_neighbours(unsigned int node_id) const
+{
+    return neighbours[node_id];
 }
 
-std::vector<unsigned int> Problem::get_vehicle_commitments(unsigned int vehicle_number) const
+unsigned int Problem::get_num_neighbours() const
 {
-    //std::cout << "Problem::get_vehicle_commitments" << std::endl;
-    return vehicles_commitments.at(vehicle_number);
+    return num_neighbours;
+}
+
+const std::vector<unsigned int> &Problem::get_local_search_neighbours(unsigned int node_id) const
+{
+    return num_neighbours > 0 ? neighbours[node_id] : local_search_neighbours[node_id];
+}
+
+const DistanceOracle &Problem::get_distance_oracle() const
+{
+    return distance_oracle;
+}
+
+const std::vector<unsigned int> &Problem::get_vehicle_commitments(unsigned int vehicle_number) const
+{
+    return vehicles_commitments[vehicle_number];
 }
 
 unsigned int Problem::get_num_vehicles() const
@@ -198,27 +636,71 @@ unsigned int Problem::get_num_available_customers() const
     return available_nodes_ids.size() - num_vehicles;
 }
 
-int Problem::get_customer_demand(unsigned int c_node_id)
+int Problem::get_customer_demand(unsigned int c_node_id) const
+{
+    return nodes_demand[c_node_id];
+}
+
+float Problem::get_customer_service_time(unsigned int c_node_id) const
+{
+    return nodes_service_time[c_node_id];
+}
+
+float Problem::get_customer_ready_time(unsigned int c_node_id) const
 {
-    return nodes[c_node_id]->demand;
+    return nodes_ready_time[c_node_id];
 }
 
-float Problem::get_customer_service_time(unsigned int c_node_id)
+float Problem::get_customer_due_date(unsigned int c_node_id) const
 {
-    return nodes[c_node_id]->service_time;
+    return nodes_due_date[c_node_id];
+}
+
+bool Problem::has_time_windows() const
+{
+    return time_windows;
+}
+
+float Problem::get_commitment_end_of_service(unsigned int c_node_id) const
+{
+    return commitments_end_of_service[c_node_id];
+}
+
+float Problem::get_departure_time(float end_of_service) const
+{
+    // Without time windows the times only order the commitments, the routes keep starting at 0
+    return time_windows ? std::max(end_of_service, last_update_time) : end_of_service;
 }
 
 bool Problem::is_node_depot(unsigned int node_id) const
 {
-    return nodes[node_id]->is_depot;
+    return nodes_is_depot[node_id];
+}
+
+bool Problem::is_streamed_customer(unsigned int c_node_id) const
+{
+    return c_node_id >= first_stream_slot && c_node_id < stream_slots_end;
 }
 
 bool Problem::has_c_node_been_committed(unsigned int c_node_id) const
 {
-    std::vector<unsigned int>::const_iterator it;
-    it = std::find(committed_c_nodes_ids.begin(), committed_c_nodes_ids.end(), c_node_id);
+    return committed_c_nodes[c_node_id];
+}
+
+bool Problem::has_c_node_been_rejected(unsigned int c_node_id) const
+{
+    return rejected_c_nodes[c_node_id];
+}
+
+bool Problem::can_be_served(unsigned int c_node_id) const
+{
+    if (nodes_demand[c_node_id] > (int)vehicle_capacity)
+    {
+        return false;
+    }
 
-    return (it != committed_c_nodes_ids.end());
+    // Every depot is at the same place
+    return !time_windows || get_departure_time(0) + get_distance(num_customers + 1, c_node_id) <= nodes_due_date[c_node_id];
 }
 
 float Problem::get_scaling_factor() const
@@ -230,7 +712,7 @@ void Problem::visual_dump_data() const
 {
     for (auto i = 0; i <= num_customers; i++)
     {
-        std::cout << nodes[i]->id << "," << nodes[i]->x << "," << nodes[i]->y << "," << nodes[i]->demand << std::endl;
+        std::cout << i << "," << nodes_x[i] << "," << nodes_y[i] << "," << nodes_demand[i] << std::endl;
     }
 }
 
@@ -239,9 +721,9 @@ void Problem::dump_to_file(const std::string &filename) const
     std::ofstream data_file;
     data_file.open(filename);
 
-    for (auto &node : nodes)
+    for (auto i = 0; i < nodes_x.size(); i++)
     {
-        data_file << node->id << ", " << node->x << ", " << node->y << ", " << node->demand << ", " << node->service_time << ", " << node->is_depot << ", " << node->available_time << std::endl;
+        data_file << i << ", " << nodes_x[i] << ", " << nodes_y[i] << ", " << nodes_demand[i] << ", " << nodes_service_time[i] << ", " << (bool)nodes_is_depot[i] << ", " << nodes_available_time[i] << std::endl;
     }
 
     data_file.close();
@@ -2,32 +2,83 @@
 
 #include <string>
 #include <vector>
-#include <map>
-
-struct Node
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "distance_oracle.h"
+#include "instance_cache.h"
+
+// Settings of Problem which do not change the instance itself
+struct ProblemOptions
 {
-    unsigned int id;
-    float x;
-    float y;
-    bool is_depot;
-    float available_time;
-    int demand;
-    float service_time;
-
-    Node(unsigned int id, float x, float y, bool is_depot, float available_time, int demand, float service_time);
+    // Size of the nearest neighbours candidate lists, 0 disables them
+    unsigned int num_neighbours = 0;
+    // Size of the neighbour lists of Local_search when there are no candidate lists, 0 when no local search is run
+    unsigned int num_local_search_neighbours = 10;
+    DistanceBackend distance_backend = DistanceBackend::Automatic;
+    // Memory the automatic distance backend may use, in bytes
+    std::size_t distance_memory_budget = (std::size_t)1 << 30;
+    // Threads used to build the distance tables
+    unsigned int num_threads = 1;
+    // Serve every customer between its ready time and its due date, the windows are always loaded
+    bool time_windows = false;
+    // Customer slots reserved after the customers of the instance for the orders streamed during the day (add_customer)
+    // Only for text instances
+    unsigned int stream_capacity = 0;
 };
 
 class Problem
 {
 private:
-    std::vector<Node *> nodes;
+    // The nodes are stored as a structure of arrays indexed by node id so that the hot loops
+    // reading one field of many nodes stay in a few cache lines
+    std::vector<float> nodes_x;
+    std::vector<float> nodes_y;
+    std::vector<uint8_t> nodes_is_depot;
+    std::vector<float> nodes_available_time;
+    std::vector<int> nodes_demand;
+    std::vector<float> nodes_service_time;
+    // Service may not start before the ready time nor after the due date
+    std::vector<float> nodes_ready_time;
+    std::vector<float> nodes_due_date;
+
+    // Ids of the nodes sorted by available_time, the ones before next_arrival have been released by update
+    std::vector<unsigned int> arrivals;
+    std::size_t next_arrival;
+
+    // The slots for streamed customers are [first_stream_slot, stream_slots_end), the free ones start at next_stream_slot
+    unsigned int first_stream_slot;
+    unsigned int next_stream_slot;
+    unsigned int stream_slots_end;
+
     std::vector<unsigned int> available_nodes_ids;
     std::vector<unsigned int> available_c_nodes_ids;
-    std::map<unsigned int, std::vector<unsigned int>> vehicles_commitments;
+    // Indexed by vehicle number, the first entry is unused
+    std::vector<std::vector<unsigned int>> vehicles_commitments;
     std::vector<unsigned int> committed_c_nodes_ids;
+    std::vector<bool> committed_c_nodes;
+    // End of service of every committed customer in the plan it was committed with, indexed by node id
+    std::vector<float> commitments_end_of_service;
+    // Customers no plan could serve, they left the available customers
+    std::vector<bool> rejected_c_nodes;
+
+    // available_c_nodes_ids sorted by increasing demand, the ants use it to bucket their candidates
+    std::vector<unsigned int> available_c_nodes_ids_by_demand;
+
+    // For every available node, its num_neighbours nearest available customers sorted by distance
+    // They are refreshed by update when new customers become available
+    unsigned int num_neighbours;
+    std::vector<std::vector<unsigned int>> neighbours;
+    // Same lists for Local_search, only kept when there are no candidate lists
+    unsigned int num_local_search_neighbours;
+    std::vector<std::vector<unsigned int>> local_search_neighbours;
+
+    bool time_windows;
 
-    // std::vector<std::vector<float>> distance_matrix;
-    std::vector<float> distances;
+    DistanceOracle distance_oracle;
+
+    // Mapping of the compiled instance the problem was loaded from, the distances may point into it
+    std::unique_ptr<MappedFile> instance_cache;
 
     unsigned int num_customers;
     unsigned int num_vehicles;
@@ -41,17 +92,45 @@ private:
     std::string dataset_name;
     float scaling_factor;
 
+    void load_text(const ProblemOptions &options);
+    void load_cache(const ProblemOptions &options);
+    void add_node(float x, float y, bool is_depot, float available_time, int demand, float service_time, float ready_time, float due_date);
+    void update_neighbours(std::vector<std::vector<unsigned int>> &lists, unsigned int list_size, const std::vector<unsigned int> &new_nodes_ids, const std::vector<unsigned int> &new_c_nodes_ids);
+    bool is_nearer(unsigned int node_id, unsigned int c_node_id_a, unsigned int c_node_id_b) const;
+
 public:
-    Problem(std::string filepath, unsigned int t_wd, unsigned int n_ts);
+    // Reads a text instance, or maps an instance cache written by write_cache
+    // Throws std::runtime_error if the instance cache can't be used
+    Problem(std::string filepath, unsigned int t_wd, unsigned int n_ts, const ProblemOptions &options);
 
-    std::vector<unsigned int> update(float time);
-    void commit(unsigned int c_node_id, unsigned int vehicle_number);
+    // Compiles the scaled instance and its distance table (unless it is computed on the fly) into an instance cache
+    bool write_cache(const std::string &filename) const;
 
-    std::vector<unsigned int> get_available_nodes_ids() const;
-    std::vector<unsigned int> get_available_c_nodes_ids() const;
-    std::vector<unsigned int> get_vehicle_commitments(unsigned int vehicle_number) const;
-    std::vector<unsigned int> get_committed_c_nodes_ids() const;
+    std::vector<unsigned int> update(float time);
+    // Puts a customer received during the day in the next free stream slot, it is released by the first update
+    // at or after available_time. The coordinates, demand, service time and window are in the units of the dataset,
+    // available_time in the units of the day. Returns the id of the customer, 0 if every slot is taken or if no vehicle
+    // could serve it (non finite coordinates, demand above the capacity, empty window or window out of reach of the depot)
+    unsigned int add_customer(float x, float y, int demand, float service_time, float ready_time, float due_date, float available_time);
+    // end_of_service is the time the plan serves the customer at, the vehicle is bound to it
+    void commit(unsigned int c_node_id, unsigned int vehicle_number, float end_of_service);
+    // The customer is turned down : it leaves the available customers, so the ants don't have to serve it anymore
+    // The neighbour lists may still name it, their readers skip the customers which are not candidates
+    void reject(unsigned int c_node_id);
+
+    // The ids getters return views on the state of the problem rather than copies
+    // A view stays valid until the next call to update (or commit for the commitments)
+    const std::vector<unsigned int> &get_available_nodes_ids() const;
+    const std::vector<unsigned int> &get_available_c_nodes_ids() const;
+    const std::vector<unsigned int> &get_vehicle_commitments(unsigned int vehicle_number) const;
+    const std::vector<unsigned int> &get_committed_c_nodes_ids() const;
+    const std::vector<unsigned int> &get_available_c_nodes_ids_by_demand() const;
     float get_distance(unsigned int node_id_i, unsigned int node_id_j) const;
+    const std::vector<unsigned int> &get_neighbours(unsigned int node_id) const;
+    unsigned int get_num_neighbours() const;
+    // The candidate lists when there are some, the lists kept for Local_search otherwise
+    const std::vector<unsigned int> &get_local_search_neighbours(unsigned int node_id) const;
+    const DistanceOracle &get_distance_oracle() const;
 
     unsigned int get_num_nodes() const;
     unsigned int get_num_available_nodes() const;
@@ -60,11 +139,25 @@ public:
     unsigned int get_vehicle_capacity() const;
     unsigned int get_num_available_customers() const;
 
-    int get_customer_demand(unsigned int c_node_id);
-    float get_customer_service_time(unsigned int c_node_id);
+    int get_customer_demand(unsigned int c_node_id) const;
+    float get_customer_service_time(unsigned int c_node_id) const;
+    float get_customer_ready_time(unsigned int c_node_id) const;
+    float get_customer_due_date(unsigned int c_node_id) const;
+    bool has_time_windows() const;
+    float get_commitment_end_of_service(unsigned int c_node_id) const;
+    // Earliest time a vehicle done at end_of_service (0 at its depot) can leave for a customer it is not committed to.
+    // With time windows the plan can't go back before the last update : a vehicle waiting at its depot
+    // or at its last commitment leaves now at the earliest
+    float get_departure_time(float end_of_service) const;
 
     bool is_node_depot(unsigned int node_id) const;
+    // The customer took a stream slot, its node was moved by add_customer
+    bool is_streamed_customer(unsigned int c_node_id) const;
     bool has_c_node_been_committed(unsigned int c_node_id) const;
+    bool has_c_node_been_rejected(unsigned int c_node_id) const;
+    // A vehicle leaving its depot now could serve the customer on its own : its demand fits in a vehicle
+    // and, with time windows, its due date can still be reached
+    bool can_be_served(unsigned int c_node_id) const;
 
     float get_scaling_factor() const;
 
@@ -0,0 +1,59 @@
+#include "random_generator.h"
+
+namespace
+{
+uint64_t splitmix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+} // namespace
+
+RandomGenerator::RandomGenerator(uint64_t seed)
+{
+    // splitmix64 spreads close seeds (0, 1, 2, ...) over the whole state space and never gives an all zero state
+    state[0] = splitmix64(seed);
+    state[1] = splitmix64(seed);
+}
+
+uint64_t RandomGenerator::next()
+{
+    // xoroshiro128+
+    uint64_t s0 = state[0];
+    uint64_t s1 = state[1];
+    uint64_t result = s0 + s1;
+
+    s1 ^= s0;
+    state[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);
+    state[1] = rotl(s1, 37);
+
+    return result;
+}
+
+float RandomGenerator::uniform()
+{
+    // We keep the 24 upper bits (the best ones for xoroshiro128+) which is exactly the precision of a float
+    return (float)(next() >> 40) * (1.0f / 16777216.0f);
+}
+
+unsigned int RandomGenerator::uniform_int(unsigned int n)
+{
+    // Lemire's multiply-shift reduction, the bias is negligible for the small n we use
+    return (unsigned int)(((next() >> 32) * (uint64_t)n) >> 32);
+}
+
+uint64_t RandomGenerator::derive_seed(uint64_t master_seed, uint64_t stream, uint64_t index)
+{
+    uint64_t x = master_seed;
+    uint64_t seed = splitmix64(x) ^ stream;
+    seed = splitmix64(seed) ^ index;
+
+    return splitmix64(seed);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Small and fast pseudo random generator (xoroshiro128+ seeded through splitmix64)
+// Every ant owns its generator so that no state is shared between threads and runs are reproducible from a master seed
+class RandomGenerator
+{
+private:
+    uint64_t state[2];
+
+public:
+    RandomGenerator(uint64_t seed);
+
+    uint64_t next();
+
+    // Uniform float in [0, 1)
+    float uniform();
+    // Uniform integer in [0, n)
+    unsigned int uniform_int(unsigned int n);
+
+    // Derives the seed of an independent stream (e.g. one per step and per ant) from the master seed
+    static uint64_t derive_seed(uint64_t master_seed, uint64_t stream, uint64_t index);
+};
@@ -0,0 +1,309 @@
+#include "selection_kernel.h"
+
+#include <atomic>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SELECTION_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+void gather_weights_scalar(const float *choice_info_row, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights)
+{
+    for (unsigned int k = 0; k < num_candidates; k++)
+    {
+        weights[k] = choice_info_row[candidate_nodes_ids[k]];
+    }
+}
+
+unsigned int argmax_scalar(const float *weights, unsigned int num_candidates)
+{
+    unsigned int index_of_max = 0;
+
+    for (unsigned int k = 1; k < num_candidates; k++)
+    {
+        if (weights[k] > weights[index_of_max])
+        {
+            index_of_max = k;
+        }
+    }
+
+    return index_of_max;
+}
+
+float prefix_sum_scalar(float *weights, unsigned int num_candidates)
+{
+    float acc = 0;
+
+    for (unsigned int k = 0; k < num_candidates; k++)
+    {
+        acc += weights[k];
+        weights[k] = acc;
+    }
+
+    return acc;
+}
+
+#ifdef SELECTION_KERNEL_X86
+
+__attribute__((target("avx2"))) void gather_weights_avx2(const float *choice_info_row, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights)
+{
+    unsigned int k = 0;
+
+    for (; k + 8 <= num_candidates; k += 8)
+    {
+        __m256i ids = _mm256_loadu_si256((const __m256i *)(candidate_nodes_ids + k));
+        _mm256_storeu_ps(weights + k, _mm256_i32gather_ps(choice_info_row, ids, 4));
+    }
+
+    gather_weights_scalar(choice_info_row, candidate_nodes_ids + k, num_candidates - k, weights + k);
+}
+
+__attribute__((target("avx2"))) unsigned int argmax_avx2(const float *weights, unsigned int num_candidates)
+{
+    if (num_candidates < 16)
+    {
+        return argmax_scalar(weights, num_candidates);
+    }
+
+    // Every lane keeps the first maximum among the indices it sees
+    __m256 max_values = _mm256_loadu_ps(weights);
+    __m256i max_indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i indices = max_indices;
+    const __m256i step = _mm256_set1_epi32(8);
+
+    unsigned int k = 8;
+    for (; k + 8 <= num_candidates; k += 8)
+    {
+        indices = _mm256_add_epi32(indices, step);
+        __m256 values = _mm256_loadu_ps(weights + k);
+        __m256 greater = _mm256_cmp_ps(values, max_values, _CMP_GT_OQ);
+
+        max_values = _mm256_blendv_ps(max_values, values, greater);
+        max_indices = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(max_indices), _mm256_castsi256_ps(indices), greater));
+    }
+
+    alignas(32) float lane_values[8];
+    alignas(32) unsigned int lane_indices[8];
+    _mm256_store_ps(lane_values, max_values);
+    _mm256_store_si256((__m256i *)lane_indices, max_indices);
+
+    // Among the lanes holding the maximum, the smallest index is the first maximum
+    unsigned int index_of_max = lane_indices[0];
+    for (unsigned int lane = 1; lane < 8; lane++)
+    {
+        if (lane_values[lane] > weights[index_of_max] || (lane_values[lane] == weights[index_of_max] && lane_indices[lane] < index_of_max))
+        {
+            index_of_max = lane_indices[lane];
+        }
+    }
+
+    // The remaining indices are all greater, they must be strictly better
+    for (; k < num_candidates; k++)
+    {
+        if (weights[k] > weights[index_of_max])
+        {
+            index_of_max = k;
+        }
+    }
+
+    return index_of_max;
+}
+
+__attribute__((target("avx2"))) float prefix_sum_avx2(float *weights, unsigned int num_candidates)
+{
+    __m256 carry = _mm256_setzero_ps();
+    const __m256i last = _mm256_set1_epi32(7);
+
+    unsigned int k = 0;
+    for (; k + 8 <= num_candidates; k += 8)
+    {
+        __m256 x = _mm256_loadu_ps(weights + k);
+
+        // Prefix sums inside each 128 bits lane
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+
+        // The upper lane gets the total of the lower lane
+        __m256 lower_total = _mm256_permute_ps(x, _MM_SHUFFLE(3, 3, 3, 3));
+        x = _mm256_add_ps(x, _mm256_permute2f128_ps(lower_total, lower_total, 0x08));
+
+        x = _mm256_add_ps(x, carry);
+        _mm256_storeu_ps(weights + k, x);
+
+        carry = _mm256_permutevar8x32_ps(x, last);
+    }
+
+    float acc = _mm256_cvtss_f32(carry);
+    for (; k < num_candidates; k++)
+    {
+        acc += weights[k];
+        weights[k] = acc;
+    }
+
+    return acc;
+}
+
+__attribute__((target("avx512f"))) void gather_weights_avx512(const float *choice_info_row, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights)
+{
+    unsigned int k = 0;
+
+    for (; k + 16 <= num_candidates; k += 16)
+    {
+        __m512i ids = _mm512_loadu_si512((const void *)(candidate_nodes_ids + k));
+        _mm512_storeu_ps(weights + k, _mm512_i32gather_ps(ids, choice_info_row, 4));
+    }
+
+    if (k < num_candidates)
+    {
+        __mmask16 mask = (__mmask16)((1u << (num_candidates - k)) - 1);
+        __m512i ids = _mm512_maskz_loadu_epi32(mask, candidate_nodes_ids + k);
+        _mm512_mask_storeu_ps(weights + k, mask, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, ids, choice_info_row, 4));
+    }
+}
+
+__attribute__((target("avx512f"))) unsigned int argmax_avx512(const float *weights, unsigned int num_candidates)
+{
+    if (num_candidates < 32)
+    {
+        return argmax_scalar(weights, num_candidates);
+    }
+
+    __m512 max_values = _mm512_loadu_ps(weights);
+    __m512i max_indices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i indices = max_indices;
+    const __m512i step = _mm512_set1_epi32(16);
+
+    unsigned int k = 16;
+    for (; k + 16 <= num_candidates; k += 16)
+    {
+        indices = _mm512_add_epi32(indices, step);
+        __m512 values = _mm512_loadu_ps(weights + k);
+        __mmask16 greater = _mm512_cmp_ps_mask(values, max_values, _CMP_GT_OQ);
+
+        max_values = _mm512_mask_mov_ps(max_values, greater, values);
+        max_indices = _mm512_mask_mov_epi32(max_indices, greater, indices);
+    }
+
+    alignas(64) float lane_values[16];
+    alignas(64) unsigned int lane_indices[16];
+    _mm512_store_ps(lane_values, max_values);
+    _mm512_store_si512((void *)lane_indices, max_indices);
+
+    unsigned int index_of_max = lane_indices[0];
+    for (unsigned int lane = 1; lane < 16; lane++)
+    {
+        if (lane_values[lane] > weights[index_of_max] || (lane_values[lane] == weights[index_of_max] && lane_indices[lane] < index_of_max))
+        {
+            index_of_max = lane_indices[lane];
+        }
+    }
+
+    for (; k < num_candidates; k++)
+    {
+        if (weights[k] > weights[index_of_max])
+        {
+            index_of_max = k;
+        }
+    }
+
+    return index_of_max;
+}
+
+__attribute__((target("avx512f"))) float prefix_sum_avx512(float *weights, unsigned int num_candidates)
+{
+    __m512 carry = _mm512_setzero_ps();
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i last = _mm512_set1_epi32(15);
+
+    unsigned int k = 0;
+    for (; k + 16 <= num_candidates; k += 16)
+    {
+        __m512 x = _mm512_loadu_ps(weights + k);
+
+        // Shifting the register up by 1, 2, 4 and 8 elements gives the prefix sums in log2(16) additions
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 15)));
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 14)));
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 12)));
+        x = _mm512_add_ps(x, _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(x), zero, 8)));
+
+        x = _mm512_add_ps(x, carry);
+        _mm512_storeu_ps(weights + k, x);
+
+        carry = _mm512_permutexvar_ps(last, x);
+    }
+
+    float acc = _mm512_cvtss_f32(carry);
+    for (; k < num_candidates; k++)
+    {
+        acc += weights[k];
+        weights[k] = acc;
+    }
+
+    return acc;
+}
+
+#endif
+
+const SelectionKernel scalar_kernel = {"scalar", gather_weights_scalar, argmax_scalar, prefix_sum_scalar};
+#ifdef SELECTION_KERNEL_X86
+const SelectionKernel avx2_kernel = {"avx2", gather_weights_avx2, argmax_avx2, prefix_sum_avx2};
+const SelectionKernel avx512_kernel = {"avx512", gather_weights_avx512, argmax_avx512, prefix_sum_avx512};
+#endif
+
+const SelectionKernel *detect_selection_kernel()
+{
+#ifdef SELECTION_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return &avx512_kernel;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &avx2_kernel;
+    }
+#endif
+    return &scalar_kernel;
+}
+
+// The ants of several threads may ask for the kernel at the same time
+std::atomic<const SelectionKernel *> selected_kernel{nullptr};
+} // namespace
+
+const SelectionKernel &get_selection_kernel()
+{
+    const SelectionKernel *kernel = selected_kernel.load(std::memory_order_acquire);
+
+    if (kernel == nullptr)
+    {
+        kernel = detect_selection_kernel();
+        selected_kernel.store(kernel, std::memory_order_release);
+    }
+
+    return *kernel;
+}
+
+bool set_selection_kernel(const std::string &name)
+{
+    if (name == "scalar")
+    {
+        selected_kernel = &scalar_kernel;
+        return true;
+    }
+#ifdef SELECTION_KERNEL_X86
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2"))
+    {
+        selected_kernel = &avx2_kernel;
+        return true;
+    }
+    if (name == "avx512" && __builtin_cpu_supports("avx512f"))
+    {
+        selected_kernel = &avx512_kernel;
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+// Innermost kernels of the ACS arc selection, working on the structure of arrays candidate buffer of the ant
+// (node ids on one side, weights on the other)
+// Every kernel has a scalar version and, on x86-64, AVX2 and AVX-512 versions.
+// The best version supported by the CPU is picked at runtime so the same binary runs on every host.
+struct SelectionKernel
+{
+    const char *name;
+
+    // weights[k] = choice_info_row[candidate_nodes_ids[k]]
+    void (*gather_weights)(const float *choice_info_row, const unsigned int *candidate_nodes_ids, unsigned int num_candidates, float *weights);
+    // Index of the first maximum weight
+    unsigned int (*argmax)(const float *weights, unsigned int num_candidates);
+    // Turns the weights into their cumulative sums in place and returns the total weight
+    // The additions are not done in the same order by every version so the last bits of the sums may differ between ISAs
+    float (*prefix_sum)(float *weights, unsigned int num_candidates);
+};
+
+// Kernel used by the ants, the best one supported by the CPU unless set_selection_kernel was called
+const SelectionKernel &get_selection_kernel();
+
+// Forces the kernel ("scalar", "avx2" or "avx512"), returns false if it is unknown or not supported by the CPU
+bool set_selection_kernel(const std::string &name);
@@ -0,0 +1,146 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int num_threads) : num_pending_tasks{0}, generation{0}, stopping{false}
+{
+    if (num_threads == 0)
+    {
+        num_threads = 1;
+    }
+
+    for (auto i = 0; i < num_threads; i++)
+    {
+        queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+
+    // Worker 0 is the thread calling run(), so we only spawn num_threads - 1 threads
+    for (auto i = 1; i < num_threads; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(unsigned int num_tasks, const std::function<void(unsigned int, unsigned int)> &job)
+{
+    if (num_tasks == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        this->job = job;
+        num_pending_tasks = num_tasks;
+
+        // We deal the tasks round-robin so that every worker starts with a fair share
+        for (auto task = 0; task < num_tasks; task++)
+        {
+            WorkerQueue &queue = *queues[task % queues.size()];
+            std::lock_guard<std::mutex> queue_lock(queue.mutex);
+            queue.tasks.push_back(task);
+        }
+
+        generation++;
+    }
+    job_available.notify_all();
+
+    // The calling thread works too
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this] { return num_pending_tasks == 0; });
+}
+
+unsigned int ThreadPool::get_num_threads() const
+{
+    return queues.size();
+}
+
+void ThreadPool::worker_loop(unsigned int worker_index)
+{
+    unsigned long last_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_available.wait(lock, [this, last_generation] { return stopping || generation != last_generation; });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            last_generation = generation;
+        }
+
+        work(worker_index);
+    }
+}
+
+void ThreadPool::work(unsigned int worker_index)
+{
+    unsigned int task;
+
+    while (pop_task(worker_index, task) || steal_task(worker_index, task))
+    {
+        job(task, worker_index);
+
+        // The last task to finish wakes up the thread waiting in run()
+        if (--num_pending_tasks == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job_done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::pop_task(unsigned int worker_index, unsigned int &task)
+{
+    WorkerQueue &queue = *queues[worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+
+    return true;
+}
+
+bool ThreadPool::steal_task(unsigned int worker_index, unsigned int &task)
+{
+    // We look at the other queues starting with our right neighbour and take from their back
+    for (auto offset = 1; offset < queues.size(); offset++)
+    {
+        WorkerQueue &queue = *queues[(worker_index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (!queue.tasks.empty())
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Persistent pool of worker threads running batches of indexed tasks.
+// Tasks of a batch are dealt round-robin to per-worker queues ; a worker pops from the front of its own queue
+// and, once it is empty, steals from the back of the other queues so that long tasks do not leave cores idle.
+// The thread calling run() takes part in the work as worker 0.
+class ThreadPool
+{
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<unsigned int> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    std::function<void(unsigned int, unsigned int)> job;
+    std::atomic<unsigned int> num_pending_tasks;
+
+    std::mutex mutex;
+    std::condition_variable job_available;
+    std::condition_variable job_done;
+    unsigned long generation;
+    bool stopping;
+
+    void worker_loop(unsigned int worker_index);
+    void work(unsigned int worker_index);
+    bool pop_task(unsigned int worker_index, unsigned int &task);
+    bool steal_task(unsigned int worker_index, unsigned int &task);
+
+public:
+    ThreadPool(unsigned int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Calls job(task, worker_index) for every task in [0, num_tasks) and returns once all of them are done
+    void run(unsigned int num_tasks, const std::function<void(unsigned int, unsigned int)> &job);
+
+    unsigned int get_num_threads() const;
+};
@@ -0,0 +1,242 @@
+#include "trace_writer.h"
+
+#include <cstring>
+
+namespace
+{
+enum RecordType : uint32_t
+{
+    TimesliceRecord,
+    InitialSolutionRecord,
+    // The rest of the buffer is unused, the next record starts at the begining
+    WrapRecord
+};
+
+// Followed by num_first_ids and num_second_ids node ids, then num_atoms tour atoms
+struct RecordHeader
+{
+    uint32_t type;
+    uint32_t timeslice;
+    uint32_t num_first_ids;
+    uint32_t num_second_ids;
+    uint32_t num_atoms;
+    float score;
+    uint64_t size;
+};
+
+uint64_t align(uint64_t size)
+{
+    return (size + 7) & ~(uint64_t)7;
+}
+} // namespace
+
+TraceWriter::TraceWriter(const std::string &directory, TraceLevel level, std::size_t buffer_size) : directory{directory}, level{level}, buffer(align(buffer_size)), head{0}, tail{0}, num_dropped{0}, stopping{false}
+{
+    thread = std::thread(&TraceWriter::writer_loop, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+bool TraceWriter::is_enabled(TraceLevel level) const
+{
+    return level <= this->level;
+}
+
+void TraceWriter::trace_timeslice(unsigned int timeslice, const Problem &problem, const std::vector<TourAtom> &best_solution)
+{
+    if (is_enabled(TraceLevel::Timeslices))
+    {
+        push(TimesliceRecord, timeslice, 0, problem.get_available_c_nodes_ids(), problem.get_committed_c_nodes_ids(), best_solution);
+    }
+}
+
+void TraceWriter::trace_initial_solution(const std::vector<TourAtom> &solution, float score)
+{
+    if (is_enabled(TraceLevel::Solutions))
+    {
+        static const std::vector<unsigned int> no_ids;
+        push(InitialSolutionRecord, 0, score, no_ids, no_ids, solution);
+    }
+}
+
+unsigned long TraceWriter::get_num_dropped() const
+{
+    return num_dropped.load();
+}
+
+bool TraceWriter::parse_level(const std::string &name, TraceLevel &level)
+{
+    if (name == "off")
+    {
+        level = TraceLevel::Off;
+    }
+    else if (name == "timeslices")
+    {
+        level = TraceLevel::Timeslices;
+    }
+    else if (name == "solutions")
+    {
+        level = TraceLevel::Solutions;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void TraceWriter::push(uint32_t type, uint32_t timeslice, float score,
+                       const std::vector<unsigned int> &first_ids, const std::vector<unsigned int> &second_ids, const std::vector<TourAtom> &solution)
+{
+    RecordHeader header = {type, timeslice, (uint32_t)first_ids.size(), (uint32_t)second_ids.size(), (uint32_t)solution.size(), score, 0};
+    std::size_t first_ids_size = first_ids.size() * sizeof(unsigned int);
+    std::size_t second_ids_size = second_ids.size() * sizeof(unsigned int);
+    std::size_t solution_size = solution.size() * sizeof(TourAtom);
+    header.size = align(sizeof(header) + first_ids_size + second_ids_size + solution_size);
+
+    std::lock_guard<std::mutex> lock(producers_mutex);
+
+    uint64_t head = this->head.load(std::memory_order_relaxed);
+    uint64_t tail = this->tail.load(std::memory_order_acquire);
+    std::size_t offset = head % buffer.size();
+    std::size_t contiguous = buffer.size() - offset;
+
+    // A record is never split, when it does not fit before the end of the buffer it starts again at the begining
+    uint64_t needed = header.size + (contiguous < header.size ? contiguous : 0);
+    if (head + needed - tail > buffer.size())
+    {
+        num_dropped++;
+        return;
+    }
+
+    if (contiguous < header.size)
+    {
+        // The writer wraps by itself when not even a header fits
+        if (contiguous >= sizeof(RecordHeader))
+        {
+            RecordHeader wrap_header = {WrapRecord, 0, 0, 0, 0, 0, contiguous};
+            std::memcpy(&buffer[offset], &wrap_header, sizeof(wrap_header));
+        }
+        head += contiguous;
+        offset = 0;
+    }
+
+    char *record = &buffer[offset];
+    std::memcpy(record, &header, sizeof(header));
+    record += sizeof(header);
+    std::memcpy(record, first_ids.data(), first_ids_size);
+    record += first_ids_size;
+    std::memcpy(record, second_ids.data(), second_ids_size);
+    record += second_ids_size;
+    std::memcpy(record, solution.data(), solution_size);
+
+    this->head.store(head + header.size, std::memory_order_release);
+
+    // Taking the mutex before notifying makes sure that the writer is either waiting or will see the record
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    condition.notify_one();
+}
+
+void TraceWriter::writer_loop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || head.load() != tail.load(); });
+
+            // The records left are written before stopping
+            if (head.load() == tail.load())
+            {
+                return;
+            }
+        }
+
+        uint64_t head = this->head.load(std::memory_order_acquire);
+        uint64_t tail = this->tail.load(std::memory_order_relaxed);
+
+        while (tail != head)
+        {
+            std::size_t offset = tail % buffer.size();
+            std::size_t contiguous = buffer.size() - offset;
+
+            if (contiguous < sizeof(RecordHeader))
+            {
+                tail += contiguous;
+                continue;
+            }
+
+            RecordHeader header;
+            std::memcpy(&header, &buffer[offset], sizeof(header));
+            if (header.type != WrapRecord)
+            {
+                write_record(&buffer[offset]);
+            }
+            tail += header.size;
+
+            // The space is given back record by record so that the colony can trace again while we write
+            this->tail.store(tail, std::memory_order_release);
+        }
+    }
+}
+
+void TraceWriter::write_record(const char *record)
+{
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+
+    std::vector<unsigned int> first_ids(header.num_first_ids);
+    std::vector<unsigned int> second_ids(header.num_second_ids);
+    std::vector<TourAtom> solution(header.num_atoms, TourAtom(0, 0, 0, 0));
+    const char *payload = record + sizeof(header);
+    std::memcpy(first_ids.data(), payload, first_ids.size() * sizeof(unsigned int));
+    payload += first_ids.size() * sizeof(unsigned int);
+    std::memcpy(second_ids.data(), payload, second_ids.size() * sizeof(unsigned int));
+    payload += second_ids.size() * sizeof(unsigned int);
+    std::memcpy(solution.data(), payload, solution.size() * sizeof(TourAtom));
+
+    if (header.type == TimesliceRecord)
+    {
+        // The available customers, the committed customers, then one tour atom per line
+        std::ofstream timeslice_data_file(directory + "/timeslice_" + std::to_string(header.timeslice) + ".txt");
+        for (auto &available_c_node_id : first_ids)
+        {
+            timeslice_data_file << available_c_node_id << ", ";
+        }
+        timeslice_data_file << '\n';
+        for (auto &committed_c_node_id : second_ids)
+        {
+            timeslice_data_file << committed_c_node_id << ", ";
+        }
+        timeslice_data_file << '\n';
+        for (auto &tour_atom : solution)
+        {
+            timeslice_data_file << tour_atom.node_id << ", " << tour_atom.load << ", " << tour_atom.end_of_service << ", " << tour_atom.distance << '\n';
+        }
+    }
+    else
+    {
+        if (!solutions_file.is_open())
+        {
+            solutions_file.open(directory + "/initial_solutions.txt");
+        }
+
+        solutions_file << "Solution @ AntColony initialization: " << '\n';
+        for (auto &tour_atom : solution)
+        {
+            solutions_file << "(" << tour_atom.node_id << ", " << tour_atom.load << ", " << tour_atom.end_of_service << ", " << tour_atom.distance << ")" << '\n';
+        }
+        solutions_file << "Score @ AntColony initialization: " << header.score << std::endl;
+    }
+}
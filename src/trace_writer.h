@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include "problem.h"
+#include "tour_atom.h"
+
+// What is traced, each level includes the previous ones
+enum class TraceLevel
+{
+    Off,
+    Timeslices, // the available and committed customers and the best solution of every timeslice
+    Solutions   // also the initial solution of every colony
+};
+
+// Writes the traces of the solver without slowing it down.
+// A trace only copies its snapshot into a ring buffer allocated once ; a background thread formats it and writes
+// the files. When the writer falls behind and the buffer is full, the new traces are dropped rather than waited for.
+// Timeslice N goes to directory/timeslice_N.txt, the initial solutions to directory/initial_solutions.txt.
+class TraceWriter
+{
+private:
+    std::string directory;
+    TraceLevel level;
+
+    std::vector<char> buffer;
+    // Bytes written and read since the start, the ring positions are taken modulo the size of the buffer
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<unsigned long> num_dropped;
+
+    // Several colonies may trace at once
+    std::mutex producers_mutex;
+
+    // Only puts the writer to sleep when there is nothing to write
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    std::thread thread;
+
+    // Only used by the writer, opened with the first initial solution
+    std::ofstream solutions_file;
+
+    void push(uint32_t type, uint32_t timeslice, float score,
+              const std::vector<unsigned int> &first_ids, const std::vector<unsigned int> &second_ids, const std::vector<TourAtom> &solution);
+    void writer_loop();
+    void write_record(const char *record);
+
+public:
+    TraceWriter(const std::string &directory, TraceLevel level, std::size_t buffer_size = (std::size_t)16 << 20);
+    // Writes the traces left in the buffer before returning
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    bool is_enabled(TraceLevel level) const;
+
+    void trace_timeslice(unsigned int timeslice, const Problem &problem, const std::vector<TourAtom> &best_solution);
+    void trace_initial_solution(const std::vector<TourAtom> &solution, float score);
+
+    unsigned long get_num_dropped() const;
+
+    static bool parse_level(const std::string &name, TraceLevel &level);
+};
@@ -0,0 +1,333 @@
+#include "working_day.h"
+
+#include <iostream>
+#include <vector>
+#include <ctime>
+
+namespace
+{
+bool timeslice_over(const std::chrono::high_resolution_clock::time_point &time_0, unsigned int timeslice, double t_ts)
+{
+    // We compute the time elapsed since the begining of the working day to find if we are still in the timeslice
+    auto now = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = now - time_0;
+
+    return elapsed.count() >= timeslice * t_ts;
+}
+
+// The CPU time of every thread of the process : the driving thread, the ants threads, the islands and the workers
+double process_cpu_time()
+{
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void reject_customer(Problem &problem, unsigned int c_node_id, const WorkingDayOptions &options)
+{
+    problem.reject(c_node_id);
+    if (options.order_stream)
+    {
+        options.order_stream->reject_customer(c_node_id);
+    }
+    if (options.verbose)
+    {
+        std::cout << "Rejection of node " << c_node_id << "\n";
+    }
+}
+
+// Turns down the customers the best solution leaves out, so that the ants can complete their solutions again
+// The problem is only changed here, between the timeslices, never while the islands update concurrently,
+// and once the local search worker is done with the solution update_solution submitted to it
+template <typename Colony>
+unsigned int reject_unserved_customers(Problem &problem, Colony &ant_colony, const WorkingDayOptions &options)
+{
+    if (ant_colony.is_best_solution_complete())
+    {
+        return 0;
+    }
+
+    // The improved solution the worker returns may be the best one, it is taken before we look for the unserved customers
+    ant_colony.synchronize_local_search();
+    if (ant_colony.is_best_solution_complete())
+    {
+        return 0;
+    }
+
+    std::vector<bool> served_c_nodes(problem.get_num_nodes() + 1, false);
+    for (auto &tour_atom : ant_colony.get_best_solution())
+    {
+        served_c_nodes[tour_atom.node_id] = true;
+    }
+
+    // Problem::reject changes the available customers, so we collect them first
+    std::vector<unsigned int> unserved_c_nodes_ids;
+    for (auto &c_node_id : problem.get_available_c_nodes_ids())
+    {
+        if (!served_c_nodes[c_node_id])
+        {
+            unserved_c_nodes_ids.push_back(c_node_id);
+        }
+    }
+
+    for (auto &c_node_id : unserved_c_nodes_ids)
+    {
+        reject_customer(problem, c_node_id, options);
+    }
+
+    ant_colony.remove_rejected_customers();
+
+    return unserved_c_nodes_ids.size();
+}
+} // namespace
+
+double elapsed_since(const std::chrono::high_resolution_clock::time_point &time)
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = now - time;
+
+    return elapsed.count();
+}
+
+template <typename Colony>
+WorkingDayResult run_working_day(Problem &problem, Colony &ant_colony, const WorkingDayOptions &options)
+{
+    WorkingDayResult result;
+    double t_ts = options.t_ts;
+
+    auto time_0 = std::chrono::high_resolution_clock::now();
+    unsigned int timeslice = 1;
+
+    // Nothing is measured when there is no sink
+    ant_colony.set_measure_timings(options.metrics_sink != nullptr);
+    TimesliceMetrics metrics;
+    std::chrono::high_resolution_clock::time_point metrics_time_0;
+
+    // The day goes on while its clock, the wall clock or the virtual one, has not reached the duration
+    auto day_over = [&]() {
+        if (options.budget == TimesliceBudget::WallTime)
+        {
+            return elapsed_since(time_0) >= options.duration;
+        }
+        return (timeslice - 1) * t_ts >= options.duration;
+    };
+
+    // The initial solution may already leave out some customers (e.g. on tight time windows)
+    unsigned int num_rejected_customers = reject_unserved_customers(problem, ant_colony, options);
+    if (options.order_stream)
+    {
+        options.order_stream->flush();
+    }
+
+    while (!day_over())
+    {
+        if (options.verbose)
+        {
+            std::cout << "Starting timeslice " << timeslice << ".\n";
+        }
+
+        if (options.metrics_sink)
+        {
+            ant_colony.reset_statistics();
+        }
+
+        unsigned int ant_colony_steps_counter = 0;
+        switch (options.budget)
+        {
+        case TimesliceBudget::WallTime:
+            while (!timeslice_over(time_0, timeslice, t_ts))
+            {
+                ant_colony.step();
+                ant_colony_steps_counter++;
+            }
+            break;
+        case TimesliceBudget::Steps:
+            while (ant_colony_steps_counter < options.steps_per_timeslice)
+            {
+                ant_colony.step();
+                ant_colony_steps_counter++;
+            }
+            break;
+        case TimesliceBudget::CpuTime:
+        {
+            double cpu_time_0 = process_cpu_time();
+            while (process_cpu_time() - cpu_time_0 < options.cpu_time_per_timeslice)
+            {
+                ant_colony.step();
+                ant_colony_steps_counter++;
+            }
+            break;
+        }
+        }
+
+        result.num_steps += ant_colony_steps_counter;
+
+        // The problem is about to change under the local search worker
+        ant_colony.synchronize_local_search();
+
+        const auto &best_solution = ant_colony.get_best_solution();
+        auto best_solution_score = ant_colony.get_best_solution_score();
+
+        if (options.verbose)
+        {
+            std::cout << "Ant Colony stepped " << ant_colony_steps_counter << " times.\n";
+            std::cout << "The current best solution score is " << best_solution_score << ".\n";
+        }
+
+        if (options.metrics_sink)
+        {
+            metrics_time_0 = std::chrono::high_resolution_clock::now();
+        }
+
+        // Here we compute which nodes from the current solution are to be committed
+        // A node from the best solution is committed if the servicing time of the vehicle serving it falls within the next t_ts seconds
+        unsigned int current_vehicle_number = best_solution[0].node_id - problem.get_num_customers();
+        for (auto i = 1; i < best_solution.size(); i++)
+        {
+            unsigned int node_id = best_solution[i].node_id;
+
+            if (problem.is_node_depot(node_id))
+            {
+                current_vehicle_number = node_id - problem.get_num_customers();
+            }
+            else
+            {
+                // We check the servicing time of the last commitment ;
+                // it needs to fall in the next step for the node to be committed
+                if (best_solution[i - 1].end_of_service < (timeslice + 1) * t_ts)
+                {
+                    // We check if the node has not already been committed
+                    if (!problem.has_c_node_been_committed(node_id))
+                    {
+                        problem.commit(node_id, current_vehicle_number, best_solution[i].end_of_service);
+                        if (options.order_stream)
+                        {
+                            options.order_stream->write_commitment(node_id, current_vehicle_number);
+                        }
+                        if (options.verbose)
+                        {
+                            std::cout << "Commitment of node " << node_id << " to vehicle " << current_vehicle_number << "\n";
+                        }
+                    }
+                }
+            }
+        }
+
+        if (options.metrics_sink)
+        {
+            metrics.commit_time = elapsed_since(metrics_time_0);
+            metrics.best_score_before_arrivals = best_solution_score;
+        }
+
+        // The snapshot is only copied, the trace writer formats it on its own thread
+        if (options.trace)
+        {
+            options.trace->trace_timeslice(timeslice, problem, best_solution);
+        }
+
+        // The orders received during the timeslice are released by the update below
+        if (options.order_stream)
+        {
+            auto orders = options.order_stream->take_orders();
+            for (auto &order : orders)
+            {
+                unsigned int c_node_id = problem.add_customer(order.x, order.y, order.demand, order.service_time, order.ready_time, order.due_date, timeslice * t_ts);
+                if (c_node_id == 0)
+                {
+                    options.order_stream->reject_order(order);
+                }
+                else
+                {
+                    options.order_stream->accept_order(c_node_id, order);
+                }
+            }
+            options.order_stream->flush();
+
+            if (options.verbose && !orders.empty())
+            {
+                std::cout << "Received " << orders.size() << " orders.\n";
+            }
+        }
+
+        // We update the problem for the new timeslice
+        auto diff = problem.update((timeslice + 1) * t_ts);
+
+        if (options.verbose)
+        {
+            std::cout << "There are " << diff.size() << " new customers available.\n";
+        }
+
+        if (options.metrics_sink)
+        {
+            metrics_time_0 = std::chrono::high_resolution_clock::now();
+        }
+
+        // The new customers no vehicle could serve on its own are turned down before they make update_solution
+        // construct whole solutions in vain
+        // The worker must not be searching while Problem::reject changes the available customers
+        ant_colony.synchronize_local_search();
+        for (auto &c_node_id : diff)
+        {
+            if (!problem.can_be_served(c_node_id))
+            {
+                reject_customer(problem, c_node_id, options);
+                num_rejected_customers++;
+            }
+        }
+
+        if (diff.size() != 0)
+        {
+            ant_colony.update_solution();
+        }
+
+        num_rejected_customers += reject_unserved_customers(problem, ant_colony, options);
+        if (options.order_stream)
+        {
+            options.order_stream->flush();
+        }
+
+        if (options.metrics_sink)
+        {
+            const ColonyStatistics &statistics = ant_colony.get_statistics();
+
+            metrics.timeslice = timeslice;
+            metrics.num_steps = statistics.num_steps;
+            metrics.num_ants_built = statistics.num_ants_built;
+            metrics.num_ants_stuck = statistics.num_ants_stuck;
+            metrics.average_candidates = statistics.num_moves > 0 ? (double)statistics.num_candidates / (double)statistics.num_moves : 0;
+            metrics.num_new_customers = diff.size();
+            metrics.num_local_search_moves = statistics.num_local_search_moves;
+            metrics.num_inserted_customers = statistics.num_inserted_customers;
+            metrics.num_rebuild_attempts = statistics.num_rebuild_attempts;
+            metrics.num_rejected_customers = num_rejected_customers;
+            metrics.construction_time = statistics.construction_time;
+            metrics.pheromon_update_time = statistics.pheromon_update_time;
+            metrics.local_search_time = statistics.local_search_time;
+            metrics.update_solution_time = elapsed_since(metrics_time_0);
+            metrics.best_score_after_arrivals = ant_colony.get_best_solution_score();
+
+            options.metrics_sink->write(metrics);
+        }
+        num_rejected_customers = 0;
+
+        if (options.verbose)
+        {
+            std::cout << "Ending timeslice " << timeslice << ".\n";
+        }
+
+        timeslice++;
+    }
+
+    result.num_timeslices = timeslice - 1;
+    result.steps_per_timeslice = result.num_timeslices > 0 ? (double)result.num_steps / (double)result.num_timeslices : 0;
+    result.score = ant_colony.get_best_solution_score();
+    // We can scale it back like that because of norms properties ( || \alpha x|| = |\alpha| ||x||)
+    result.scaled_back_score = result.score / problem.get_scaling_factor();
+    result.runtime = elapsed_since(time_0);
+
+    return result;
+}
+
+template WorkingDayResult run_working_day<AntColony>(Problem &problem, AntColony &ant_colony, const WorkingDayOptions &options);
+template WorkingDayResult run_working_day<IslandModel>(Problem &problem, IslandModel &ant_colony, const WorkingDayOptions &options);
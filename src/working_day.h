@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include "problem.h"
+#include "ant_colony.h"
+#include "island_model.h"
+#include "metrics.h"
+#include "order_stream.h"
+#include "trace_writer.h"
+
+// What bounds the optimization of a timeslice
+enum class TimesliceBudget
+{
+    WallTime, // t_ts seconds of wall clock, the day takes as long as it would in production
+    Steps,    // a fixed number of colony steps, the day is reproducible for a given seed
+    CpuTime   // a fixed CPU time of the whole process, all the threads of the colony included, insensitive to the load of the host
+};
+
+struct WorkingDayOptions
+{
+    // Length of a timeslice, in units of the day (seconds of wall clock with the WallTime budget)
+    double t_ts = 2;
+    // The day is stopped after that many units
+    double duration = 75;
+
+    // With the Steps and CpuTime budgets the time of the day is virtual,
+    // a timeslice ends as soon as its budget is spent
+    TimesliceBudget budget = TimesliceBudget::WallTime;
+    unsigned long steps_per_timeslice = 0;
+    double cpu_time_per_timeslice = 0;
+
+    // Print the progress of the day (timeslices, commitments, ...), the lines are not flushed one by one
+    bool verbose = true;
+    // Receives the state of every timeslice, nullptr to trace nothing
+    TraceWriter *trace = nullptr;
+    // Receives the metrics of every timeslice, nullptr to disable them
+    MetricsSink *metrics_sink = nullptr;
+    // Receives the orders of a live day and the commitments, nullptr when every customer comes from the instance
+    // The problem must have been loaded with stream slots
+    OrderStream *order_stream = nullptr;
+};
+
+struct WorkingDayResult
+{
+    unsigned int num_timeslices = 0;
+    unsigned long num_steps = 0;
+    double steps_per_timeslice = 0;
+    float score = 0;
+    // The score in the units of the dataset
+    float scaled_back_score = 0;
+    double runtime = 0;
+};
+
+// Simulates a working day : the colony optimizes during each timeslice, then the customers served soon enough
+// by the best solution are committed and the customers which became available are inserted
+// The problem must have been updated to time 0 before the colony was created
+// Colony is an AntColony or an IslandModel, the day is instantiated for both in working_day.cpp
+template <typename Colony>
+WorkingDayResult run_working_day(Problem &problem, Colony &ant_colony, const WorkingDayOptions &options);
+
+extern template WorkingDayResult run_working_day<AntColony>(Problem &problem, AntColony &ant_colony, const WorkingDayOptions &options);
+extern template WorkingDayResult run_working_day<IslandModel>(Problem &problem, IslandModel &ant_colony, const WorkingDayOptions &options);
+
+double elapsed_since(const std::chrono::high_resolution_clock::time_point &time);